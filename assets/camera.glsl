@@ -6,6 +6,7 @@ layout (std140) uniform ubo_camera {
   mat4 view_project;
   mat4 view;
   mat4 model;
+  mat4 decode;
   vec3 view_pos;
 };
 
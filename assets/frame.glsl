@@ -0,0 +1,19 @@
+#ifndef FRAME_GLSL
+#define FRAME_GLSL
+
+// named so view does not clash with ubo_camera's
+layout (std140) uniform ubo_frame {
+  mat4 view;
+  mat4 project;
+  mat4 inv_view;
+  mat4 inv_project;
+  mat4 prev_view_project;
+  vec2 resolution;
+  float z_near;
+  float z_far;
+  float z_scale;
+  float z_offset;
+  float time;
+} frame;
+
+#endif
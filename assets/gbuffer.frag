@@ -11,15 +11,22 @@ in mat3 vs_TBN;
 
 uniform sampler2D u_albedo;
 uniform sampler2D u_normal;
-uniform sampler2D u_roughness;
+uniform sampler2D u_orm;
 
 void main() {
   vec3 light = vec3(0.0);
 
   vec3 albedo = texture(u_albedo, vs_uv).xyz;
-  float roughness = texture(u_roughness, vs_uv).r;
+  vec3 orm = texture(u_orm, vs_uv).rgb;
+  float occlusion = orm.r;
+  float roughness = orm.g;
+  float metalness = orm.b;
 
-  vec3 N = normalize(vs_TBN * (texture(u_normal, vs_uv).xyz * 2.0 - 1.0));
+  // normal maps only store x and y
+  vec2 N_xy = texture(u_normal, vs_uv).xy * 2.0 - 1.0;
+  vec3 N_tangent = vec3(N_xy, sqrt(max(1.0 - dot(N_xy, N_xy), 0.0)));
+
+  vec3 N = normalize(vs_TBN * N_tangent);
   vec3 V = normalize(view_pos - vs_pos);
 
   for (int i = 0; i < MAX_LIGHTS; i++) {
@@ -33,9 +40,10 @@ void main() {
     vec3 radiance = lights[i].radiance * lights[i].intensity;
     float attenuation = 1.0 / dot(delta_light_frag, delta_light_frag);
 
-    light += radiance * attenuation * CookTorranceBRDF(albedo, 0.05, roughness, L, V, N) * NdotL;
+    light += radiance * attenuation * CookTorranceBRDF(albedo, metalness, roughness, L, V, N) * NdotL;
   }
 
-  g_radiance = vec4(light, 1.0);
+  // baked occlusion darkens the radiance the same way the SSAO pass does
+  g_radiance = vec4(light * occlusion, 1.0);
   g_normal = vec4(normalize(vec3(view_project * vec4(N, 0.0))), roughness);
 }
@@ -1,8 +1,6 @@
 #ifndef LIGHTING_GLSL
 #define LIGHTING_GLSL
 
-#define MAX_LIGHTS 4
-
 struct ubo_light {
   vec3 position;
   float pad1;
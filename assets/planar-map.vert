@@ -1,10 +1,9 @@
 #pragma use "camera.glsl"
 
-layout(location = 0) in vec3 v_pos;
-layout(location = 1) in vec3 v_normal;
-layout(location = 2) in vec3 v_tangent;
-layout(location = 3) in vec3 v_bitangent;
-layout(location = 4) in vec2 v_uv;
+layout(location = 0) in vec4 v_pos;
+layout(location = 1) in vec4 v_normal;
+layout(location = 2) in vec4 v_tangent;
+layout(location = 3) in vec2 v_uv;
 
 out vec2 vs_uv;
 out vec3 vs_pos;
@@ -12,13 +11,15 @@ out mat3 vs_TBN;
 
 void main()
 {
-  vec3 T = normalize(vec3(model * vec4(v_tangent, 0.0)));
-  vec3 B = normalize(vec3(model * vec4(v_bitangent, 0.0)));
-  vec3 N = normalize(vec3(model * vec4(v_normal, 0.0)));
+  vec4 pos = decode * vec4(v_pos.xyz, 1.0);
+
+  vec3 T = normalize(vec3(model * vec4(v_tangent.xyz, 0.0)));
+  vec3 N = normalize(vec3(model * vec4(v_normal.xyz, 0.0)));
+  vec3 B = cross(N, T) * v_tangent.w;
 
   vs_TBN = mat3(T, B, N);
-  vs_pos = (model * vec4(v_pos, 1.0)).xyz;
+  vs_pos = (model * pos).xyz;
   vs_uv = (transpose(vs_TBN) * vs_pos).xy * 0.75;
 
-  gl_Position = MVP * vec4(v_pos, 1.0);
+  gl_Position = MVP * pos;
 }
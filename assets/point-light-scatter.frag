@@ -1,4 +1,5 @@
 #pragma use "camera.glsl"
+#pragma use "frame.glsl"
 #pragma use "lighting.glsl"
 
 in vec2 vs_uv;
@@ -10,13 +11,8 @@ uniform sampler2D u_normal;
 uniform sampler2D u_radiance;
 
 void main() {
-  float near = 0.1;
-  float far = 100.0;
-  float z_scale = (-far + -near) / (-far - -near);
-  float z_offset = (2.0 * -far * -near) / (-far - -near);
-
   float depth = texture(u_depth, vs_uv).z;
-  float z = z_offset / (depth - z_scale);
+  float z = frame.z_offset / (depth - frame.z_scale);
 
   vec3 frag_pos = vec3((vs_uv * 2.0 - 1.0) * z, z);
 
@@ -24,14 +20,12 @@ void main() {
   vec3 N = texture(u_normal, vs_uv).xyz;
   vec3 color = texture(u_radiance, vs_uv).xyz;
 
-  mat4 inv_view = inverse(view);
-
   for (int i = 0; i < MAX_LIGHTS; i++) {
     if (lights[i].intensity <= 0.0) {
       continue;
     }
 
-    vec3 light_pos = (vec4(lights[i].position - view_pos, 1.0) * inv_view).xyz;
+    vec3 light_pos = (vec4(lights[i].position - view_pos, 1.0) * frame.inv_view).xyz;
     vec3 L = normalize(light_pos - frag_pos);
 
     vec3 dir = normalize(L - V * dot(L, V));
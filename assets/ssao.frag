@@ -1,3 +1,5 @@
+#pragma use "frame.glsl"
+
 in vec2 vs_uv;
 
 out vec4 frag_color;
@@ -6,16 +8,11 @@ uniform sampler2D u_depth;
 uniform sampler2D u_normal;
 uniform sampler2D u_radiance;
 
-uniform vec3 u_samples[32];
+uniform vec3 u_samples[SSAO_SAMPLES];
 
 void main() {
-  float near = 0.1;
-  float far = 100.0;
-  float z_scale = (-far + -near) / (-far - -near);
-  float z_offset = (2.0 * -far * -near) / (-far - -near);
-
   float depth = texture(u_depth, vs_uv).z;
-  float z = z_offset / (depth * 2.0 - 1.0 - z_scale);
+  float z = frame.z_offset / (depth * 2.0 - 1.0 - frame.z_scale);
   vec3 frag_pos = vec3((vs_uv * 2.0 - 1.0) * z, z);
 
   vec3 normal = texture(u_normal, vs_uv).xyz;
@@ -30,7 +27,7 @@ void main() {
   float radius = 0.125;
   float bias = 0.03;
   
-  for (int i = 0; i < 32; i++) {
+  for (int i = 0; i < SSAO_SAMPLES; i++) {
     vec3 sample_pos = frag_pos + (TBN * u_samples[i]) * radius;
     vec2 screen_pos = (sample_pos.xy / sample_pos.z) * 0.5 + 0.5;
     
@@ -43,13 +40,13 @@ void main() {
     }
     
     float sample_depth = texture(u_depth, screen_pos).z;
-    sample_depth = z_offset / (sample_depth * 2.0 - 1.0 - z_scale);
+    sample_depth = frame.z_offset / (sample_depth * 2.0 - 1.0 - frame.z_scale);
     
     float range_check = smoothstep(0.0, 1.0, radius / abs(sample_pos.z - sample_depth));
     occlusion += (sample_depth + bias < sample_pos.z ? 1.0 : 0.0) * range_check;
   }
 
-  occlusion = pow(1.0 - occlusion / 32.0, 4.0);
+  occlusion = pow(1.0 - occlusion / float(SSAO_SAMPLES), 4.0);
 
   vec3 color = texture(u_radiance, vs_uv).xyz * occlusion;
 
@@ -1,4 +1,5 @@
 #pragma use "camera.glsl"
+#pragma use "frame.glsl"
 #pragma use "PBR.glsl"
 
 in vec2 vs_uv;
@@ -9,8 +10,6 @@ uniform sampler2D u_depth;
 uniform sampler2D u_normal;
 uniform sampler2D u_radiance;
 
-uniform float g_time;
-
 float rand(vec2 co) {
   return fract(sin(dot(co, vec2(12.9898, 78.233))) * 43758.5453);
 }
@@ -22,7 +21,7 @@ float f(vec2 p) {
     float x = rand(vec2(i, i * 10.0));
     float y = rand(vec2(i, x * 1000.0));
     vec2 q = (vec2(x, y) - 0.5) * 2.0 * 10.0;
-    z += cos((length(p - q) + g_time * x * y * 8.0) * 10.0) * y;
+    z += cos((length(p - q) + frame.time * x * y * 8.0) * 10.0) * y;
   }
   
   return z * 0.05;
@@ -39,13 +38,8 @@ vec3 calculate_water_normal(vec2 p) {
 }
 
 void main() {
-  float near = 0.1;
-  float far = 100.0;
-  float z_scale = (-far + -near) / (-far - -near);
-  float z_offset = (2.0 * -far * -near) / (-far - -near);
-
   float depth = texture(u_depth, vs_uv).z;
-  float z = z_offset / (depth * 2.0 - 1.0 - z_scale);
+  float z = frame.z_offset / (depth * 2.0 - 1.0 - frame.z_scale);
   vec3 frag_pos = vec3((vs_uv * 2.0 - 1.0) * z, z);
 
   vec3 rd = normalize(vec3(vs_uv * 2.0 - 1.0, 1.0) * mat3(view));
@@ -58,7 +52,7 @@ void main() {
   
   vec3 color = texture(u_radiance, vs_uv).xyz;
 
-  mat3 inv_view = transpose(mat3(view));
+  mat3 inv_view = mat3(frame.inv_view);
 
   if (
     td > 0.0 && td < length(frag_pos)
@@ -70,14 +64,14 @@ void main() {
     vec3 R = refract(V, N, 1.0 / 1.33);
     vec3 diffuse = color;
     
-    for (int i = 0; i < 128; i++) {
-      new_pos += R / 32.0 * (new_pos.z + R.z / 32.0);
+    for (int i = 0; i < SSR_STEPS; i++) {
+      new_pos += R / SSR_STEP_DIVISOR * (new_pos.z + R.z / SSR_STEP_DIVISOR);
 
       vec2 uv = new_pos.xy / new_pos.z * 0.5 + 0.5;
       depth = texture(u_depth, uv).z;
-      z = z_offset / (depth * 2.0 - 1.0 - z_scale);
+      z = frame.z_offset / (depth * 2.0 - 1.0 - frame.z_scale);
 
-      if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0 || new_pos.z < 0.1) break;
+      if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0 || new_pos.z < frame.z_near) break;
 
       if (new_pos.z > z + 0.01 && new_pos.z < z + 1.0) {
         diffuse = texture(u_radiance, uv).xyz;
@@ -91,14 +85,14 @@ void main() {
     R = reflect(V, N);
     vec3 specular = vec3(0.0);
 
-    for (int i = 0; i < 128; i++) {
-      new_pos += R / 32.0 * (new_pos.z + R.z / 32.0);
+    for (int i = 0; i < SSR_STEPS; i++) {
+      new_pos += R / SSR_STEP_DIVISOR * (new_pos.z + R.z / SSR_STEP_DIVISOR);
 
       vec2 uv = new_pos.xy / new_pos.z * 0.5 + 0.5;
       depth = texture(u_depth, uv).z;
-      z = z_offset / (depth * 2.0 - 1.0 - z_scale);
+      z = frame.z_offset / (depth * 2.0 - 1.0 - frame.z_scale);
 
-      if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0 || new_pos.z < 0.1) break;
+      if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0 || new_pos.z < frame.z_near) break;
 
       if (new_pos.z > z + 0.01 && new_pos.z < z + 1.0) {
         specular = texture(u_radiance, uv).xyz * pow(0.94, float(i));
@@ -43,24 +43,24 @@ void game_t::control_character_movement(input_t& input) {
   if (!has_component(character_body.entity, HAS_TRANSFORM)) return;
   
   transform_t &transform = get_transform(character_body.entity);
-  transform.rotation = vec3(-input.get_axis(1), -input.get_axis(0), 0.0);
+  transform.rotation = quat::rotate_xyz(vec3(-input.get_axis(1), -input.get_axis(0), 0.0));
   
   vec3 wish_dir = vec3();
   
   if (input.get_axis(2)) {
-    wish_dir += (mat4::rotate_xyz(transform.rotation) * vec4(0, 0, 1, 1)).get_xyz();
+    wish_dir += transform.rotation.rotate(vec3(0, 0, 1));
   }
   
   if (input.get_axis(3)) {
-    wish_dir += (mat4::rotate_xyz(transform.rotation) * vec4(-1, 0, 0, 1)).get_xyz();
+    wish_dir += transform.rotation.rotate(vec3(-1, 0, 0));
   }
   
   if (input.get_axis(4)) {
-    wish_dir += (mat4::rotate_xyz(transform.rotation) * vec4(0, 0, -1, 1)).get_xyz();
+    wish_dir += transform.rotation.rotate(vec3(0, 0, -1));
   }
   
   if (input.get_axis(5)) {
-    wish_dir += (mat4::rotate_xyz(transform.rotation) * vec4(1, 0, 0, 1)).get_xyz();
+    wish_dir += transform.rotation.rotate(vec3(1, 0, 0));
   }
 
   wish_dir.y = 0.0;
@@ -9,7 +9,7 @@ using entity_t = int;
 class transform_t {
 public:
   vec3 position;
-  vec3 rotation;
+  quat rotation;
   vec3 scale;
   
   inline transform_t() {}
@@ -18,7 +18,7 @@ public:
     position = _position;
   }
   
-  void rotate_to(vec3 _rotation) {
+  void rotate_to(quat _rotation) {
     rotation = _rotation;
   }
   
@@ -29,7 +29,9 @@ public:
 
 enum meshname_t {
   MESH_PLANE,
-  MESH_CUBOID
+  MESH_CUBOID,
+  MESH_COLUMN,
+  MESH_PLINTH
 };
 
 enum materialname_t {
@@ -17,6 +17,24 @@ void create_cuboid(game_t& game, vec3 a, vec3 b, materialname_t material) {
   game.enable_model(e, model_t(MESH_CUBOID, material));
 }
 
+void create_column(game_t& game, vec3 a, float height, materialname_t material) {
+  entity_t e = game.add_entity();
+  transform_t& transform = game.enable_transform(e, transform_t());
+    transform.move_to(a);
+    transform.scale_to(vec3(1.0, height / 3.0, 1.0));
+  game.enable_aabb(e, aabb_t(vec3(-0.45, 0.0, -0.45), vec3(0.45, height, 0.45)));
+  game.enable_model(e, model_t(MESH_COLUMN, material));
+}
+
+void create_plinth(game_t& game, vec3 a, materialname_t material) {
+  entity_t e = game.add_entity();
+  transform_t& transform = game.enable_transform(e, transform_t());
+    transform.move_to(a);
+    transform.scale_to(vec3(1.0));
+  game.enable_aabb(e, aabb_t(vec3(-0.6, 0.0, -0.6), vec3(0.6, 0.3, 0.6)));
+  game.enable_model(e, model_t(MESH_PLINTH, material));
+}
+
 int main(int argc, char** argv) {
   input_t input;
   input.bind_move(0, 1);
@@ -62,6 +80,17 @@ int main(int argc, char** argv) {
   create_cuboid(game, vec3(-5.0, 0.0, 3.0), vec3(2.0, 0.5, 4.0), MATERIAL_TILE);
   create_cuboid(game, vec3(-10.0, 0.0, 7.0), vec3(7.0, 0.5, 4.0), MATERIAL_TILE);
   
+  create_column(game, vec3(-9.0, 0.0, -9.0), 5.0, MATERIAL_TILE);
+  create_column(game, vec3(-9.0, 0.0, -15.0), 5.0, MATERIAL_TILE);
+  create_column(game, vec3(-15.0, 0.0, -9.0), 5.0, MATERIAL_TILE);
+  create_column(game, vec3(-15.0, 0.0, -15.0), 5.0, MATERIAL_TILE);
+  
+  // the plinth has no uvs, so it only takes untextured materials
+  create_plinth(game, vec3(-9.0, 0.0, -9.0), MATERIAL_DEFAULT);
+  create_plinth(game, vec3(-9.0, 0.0, -15.0), MATERIAL_DEFAULT);
+  create_plinth(game, vec3(-15.0, 0.0, -9.0), MATERIAL_DEFAULT);
+  create_plinth(game, vec3(-15.0, 0.0, -15.0), MATERIAL_DEFAULT);
+  
   renderer_t renderer(game);
   renderer.bind();
   
@@ -0,0 +1,173 @@
+#include "command_buffer.hpp"
+#include <cstring>
+
+struct command_header_t {
+  command_type_t type;
+  int size;
+};
+
+struct command_pass_t {
+  target_t* target;
+  int width;
+  int height;
+};
+
+struct command_bind_shader_t {
+  const shader_t* shader;
+};
+
+struct command_bind_texture_t {
+  texture_t* texture;
+  int channel;
+};
+
+struct command_uniform_float_t {
+  uniform_t uniform;
+  float value;
+};
+
+struct command_sub_t {
+  uniform_buffer_t* uniform_buffer;
+  int offset;
+  int size;
+};
+
+struct command_draw_t {
+  mesh_t mesh;
+  int lod;
+};
+
+static const int COMMAND_ALIGN = 16;
+
+static int command_align(int size) {
+  return (size + COMMAND_ALIGN - 1) & ~(COMMAND_ALIGN - 1);
+}
+
+command_buffer_t::command_buffer_t() {
+  m_data.reserve(4096);
+}
+
+void command_buffer_t::reset() {
+  m_data.clear();
+}
+
+void* command_buffer_t::push(command_type_t type, int size) {
+  int header_size = command_align(sizeof(command_header_t));
+  int total_size = header_size + command_align(size);
+  
+  size_t offset = m_data.size();
+  m_data.resize(offset + total_size);
+  
+  command_header_t* header = (command_header_t*) &m_data[offset];
+  header->type = type;
+  header->size = total_size;
+  
+  return &m_data[offset + header_size];
+}
+
+void command_buffer_t::begin_pass(target_t* target, int width, int height) {
+  command_pass_t* command = (command_pass_t*) push(COMMAND_BEGIN_PASS, sizeof(command_pass_t));
+  command->target = target;
+  command->width = width;
+  command->height = height;
+}
+
+void command_buffer_t::end_pass(target_t* target) {
+  command_pass_t* command = (command_pass_t*) push(COMMAND_END_PASS, sizeof(command_pass_t));
+  command->target = target;
+  command->width = 0;
+  command->height = 0;
+}
+
+void command_buffer_t::bind_shader(const shader_t& shader) {
+  command_bind_shader_t* command = (command_bind_shader_t*) push(COMMAND_BIND_SHADER, sizeof(command_bind_shader_t));
+  command->shader = &shader;
+}
+
+void command_buffer_t::bind_texture(texture_t& texture, int channel) {
+  command_bind_texture_t* command = (command_bind_texture_t*) push(COMMAND_BIND_TEXTURE, sizeof(command_bind_texture_t));
+  command->texture = &texture;
+  command->channel = channel;
+}
+
+void command_buffer_t::uniform_float(uniform_t uniform, float value) {
+  command_uniform_float_t* command = (command_uniform_float_t*) push(COMMAND_UNIFORM_FLOAT, sizeof(command_uniform_float_t));
+  command->uniform = uniform;
+  command->value = value;
+}
+
+void command_buffer_t::sub(uniform_buffer_t& uniform_buffer, const void* data, int offset, int size) {
+  int header_size = command_align(sizeof(command_sub_t));
+  unsigned char* payload = (unsigned char*) push(COMMAND_SUB_UNIFORM_BUFFER, header_size + size);
+  
+  command_sub_t* command = (command_sub_t*) payload;
+  command->uniform_buffer = &uniform_buffer;
+  command->offset = offset;
+  command->size = size;
+  
+  memcpy(payload + header_size, data, size);
+}
+
+void command_buffer_t::draw(mesh_t mesh, int lod) {
+  command_draw_t* command = (command_draw_t*) push(COMMAND_DRAW, sizeof(command_draw_t));
+  command->mesh = mesh;
+  command->lod = lod;
+}
+
+void command_buffer_t::replay() {
+  int header_size = command_align(sizeof(command_header_t));
+  size_t offset = 0;
+  
+  while (offset < m_data.size()) {
+    command_header_t* header = (command_header_t*) &m_data[offset];
+    unsigned char* payload = &m_data[offset + header_size];
+    
+    switch (header->type) {
+    case COMMAND_BEGIN_PASS: {
+      command_pass_t* command = (command_pass_t*) payload;
+      if (command->target) {
+        command->target->bind();
+      } else {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      }
+      glViewport(0, 0, command->width, command->height);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      break;
+    }
+    case COMMAND_END_PASS: {
+      command_pass_t* command = (command_pass_t*) payload;
+      if (command->target) {
+        command->target->unbind();
+      }
+      break;
+    }
+    case COMMAND_BIND_SHADER: {
+      command_bind_shader_t* command = (command_bind_shader_t*) payload;
+      command->shader->bind();
+      break;
+    }
+    case COMMAND_BIND_TEXTURE: {
+      command_bind_texture_t* command = (command_bind_texture_t*) payload;
+      command->texture->bind(command->channel);
+      break;
+    }
+    case COMMAND_UNIFORM_FLOAT: {
+      command_uniform_float_t* command = (command_uniform_float_t*) payload;
+      command->uniform.set(command->value);
+      break;
+    }
+    case COMMAND_SUB_UNIFORM_BUFFER: {
+      command_sub_t* command = (command_sub_t*) payload;
+      command->uniform_buffer->sub(payload + command_align(sizeof(command_sub_t)), command->offset, command->size);
+      break;
+    }
+    case COMMAND_DRAW: {
+      command_draw_t* command = (command_draw_t*) payload;
+      command->mesh.draw(command->lod);
+      break;
+    }
+    }
+    
+    offset += header->size;
+  }
+}
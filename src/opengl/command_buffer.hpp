@@ -0,0 +1,43 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include <glad/glad.h>
+#include <vector>
+#include "shader.hpp"
+#include "target.hpp"
+#include "texture.hpp"
+#include "uniform_buffer.hpp"
+#include "vertex_buffer.hpp"
+
+enum command_type_t {
+  COMMAND_BEGIN_PASS,
+  COMMAND_END_PASS,
+  COMMAND_BIND_SHADER,
+  COMMAND_BIND_TEXTURE,
+  COMMAND_UNIFORM_FLOAT,
+  COMMAND_SUB_UNIFORM_BUFFER,
+  COMMAND_DRAW
+};
+
+// Commands are recorded into linear memory without touching GL, so any thread
+// can record. replay() must run on the thread that owns the GL context.
+class command_buffer_t {
+private:
+  std::vector<unsigned char> m_data;
+  
+  void* push(command_type_t type, int size);
+
+public:
+  command_buffer_t();
+  void reset();
+  void begin_pass(target_t* target, int width, int height);
+  void end_pass(target_t* target);
+  void bind_shader(const shader_t& shader);
+  void bind_texture(texture_t& texture, int channel);
+  void uniform_float(uniform_t uniform, float value);
+  void sub(uniform_buffer_t& uniform_buffer, const void* data, int offset, int size);
+  void draw(mesh_t mesh, int lod = 0);
+  void replay();
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "program_cache.hpp"
+#include <util/hash.hpp>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+
+#define PROGRAM_CACHE_DIR "cache/shaders"
+
+static std::filesystem::path program_cache_path(uint64_t key) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) key);
+  return std::filesystem::path(PROGRAM_CACHE_DIR) / name;
+}
+
+static uint64_t program_cache_driver_hash() {
+  static uint64_t driver_hash = 0;
+  
+  if (!driver_hash) {
+    const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    driver_hash = HASH_SEED;
+    
+    for (GLenum name : names) {
+      const char* str = (const char*) glGetString(name);
+      driver_hash = hash_string(str ? str : "", driver_hash);
+    }
+  }
+  
+  return driver_hash;
+}
+
+uint64_t program_cache_key(const std::string& src_vertex, const std::string& src_fragment) {
+  uint64_t key = program_cache_driver_hash();
+  key = hash_string(src_vertex, key);
+  key = hash_string(src_fragment, key);
+  return key;
+}
+
+bool program_cache_load(GLuint program, uint64_t key) {
+  std::ifstream in(program_cache_path(key), std::ios::binary);
+  if (!in) return false;
+  
+  GLenum format;
+  if (!in.read((char*) &format, sizeof(format))) return false;
+  
+  std::vector<char> binary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (binary.empty()) return false;
+  
+  glProgramBinary(program, format, binary.data(), (GLsizei) binary.size());
+  
+  // drivers reject binaries after an update, the caller falls back to a full compile
+  int success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  return success;
+}
+
+void program_cache_store(GLuint program, uint64_t key) {
+  int length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) return;
+  
+  std::vector<char> binary(length);
+  GLenum format;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+  
+  std::error_code error;
+  std::filesystem::create_directories(PROGRAM_CACHE_DIR, error);
+  
+  std::filesystem::path path = program_cache_path(key);
+  std::filesystem::path tmp_path = path;
+  tmp_path += ".tmp";
+  
+  {
+    std::ofstream out(tmp_path, std::ios::binary);
+    if (!out) {
+      std::cerr << "warning: program_cache_store: could not write " << tmp_path << std::endl;
+      return;
+    }
+    
+    out.write((const char*) &format, sizeof(format));
+    out.write(binary.data(), length);
+  }
+  
+  std::filesystem::rename(tmp_path, path, error);
+}
@@ -0,0 +1,12 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+uint64_t program_cache_key(const std::string& src_vertex, const std::string& src_fragment);
+bool program_cache_load(GLuint program, uint64_t key);
+void program_cache_store(GLuint program, uint64_t key);
+
+#endif
@@ -1,66 +1,198 @@
 #include "shader.hpp"
+#include "program_cache.hpp"
+#include <util/hash.hpp>
 #include <iostream>
 #include <fstream>
-#include <regex>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <string_view>
+#include <unordered_map>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 static GLuint shader_compile(GLuint type, const char* src);
+static GLuint shader_acquire(GLuint type, const std::string& src, uint64_t& key);
+static void shader_release(uint64_t key);
+static void shader_check(GLuint shader);
+static void shader_print_sources();
 
-shader_t::shader_t(const std::stringstream& src_vertex, const std::stringstream& src_fragment) {
-  GLuint vertex_shader = shader_compile(GL_VERTEX_SHADER, src_vertex.str().c_str());
-  GLuint fragment_shader = shader_compile(GL_FRAGMENT_SHADER, src_fragment.str().c_str());
+static bool has_parallel_shader_compile() {
+  static int supported = -1;
+  
+  if (supported < 0) {
+    supported = 0;
+    
+    int num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    
+    for (int i = 0; i < num_extensions; i++) {
+      const char* name = (const char*) glGetStringi(GL_EXTENSIONS, i);
+      if (name && strcmp(name, "GL_KHR_parallel_shader_compile") == 0) {
+        supported = 1;
+        break;
+      }
+    }
+  }
   
+  return supported;
+}
+
+// Compilation and linking are only submitted here. Status is not queried
+// until is_ready() or wait(), so the driver can work on every program the
+// renderer creates at once instead of blocking on each in turn.
+shader_t::shader_t(const std::string& src_vertex, const std::string& src_fragment) {
   m_program = glCreateProgram();
+  m_vertex_shader = 0;
+  m_fragment_shader = 0;
+  m_ready = false;
+  m_cache_key = program_cache_key(src_vertex, src_fragment);
+  
+  if (program_cache_load(m_program, m_cache_key)) {
+    reflect();
+    m_ready = true;
+    return;
+  }
   
-  glAttachShader(m_program, vertex_shader);
-  glAttachShader(m_program, fragment_shader);
+  m_vertex_shader = shader_acquire(GL_VERTEX_SHADER, src_vertex, m_vertex_key);
+  m_fragment_shader = shader_acquire(GL_FRAGMENT_SHADER, src_fragment, m_fragment_key);
   
-  int success;
+  glAttachShader(m_program, m_vertex_shader);
+  glAttachShader(m_program, m_fragment_shader);
+  glProgramParameteri(m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   glLinkProgram(m_program);
+}
+
+bool shader_t::is_ready() {
+  if (m_ready) return true;
+  
+  if (has_parallel_shader_compile()) {
+    int complete;
+    glGetProgramiv(m_program, GL_COMPLETION_STATUS_KHR, &complete);
+    if (!complete) return false;
+  }
+  
+  finalize();
+  return true;
+}
+
+void shader_t::wait() {
+  if (!m_ready) finalize();
+}
+
+void shader_t::on_ready(std::function<void(shader_t&)> fn) {
+  if (m_ready) {
+    fn(*this);
+  } else {
+    m_on_ready.push_back(std::move(fn));
+  }
+}
+
+void shader_t::finalize() {
+  int success;
   glGetProgramiv(m_program, GL_LINK_STATUS, &success);
   
   if (!success) {
+    shader_check(m_vertex_shader);
+    shader_check(m_fragment_shader);
+    
     static char info[1024];
     glGetProgramInfoLog(m_program, sizeof(info), NULL, info);
     std::cerr << "error: shader_compile: " << info;
     throw std::runtime_error("failed to link shader");
   }
   
-  glDetachShader(m_program, vertex_shader);
-  glDetachShader(m_program, vertex_shader);
-  glDeleteShader(vertex_shader);
-  glDeleteShader(fragment_shader);
+  glDetachShader(m_program, m_vertex_shader);
+  glDetachShader(m_program, m_fragment_shader);
+  shader_release(m_vertex_key);
+  shader_release(m_fragment_key);
+  m_vertex_shader = 0;
+  m_fragment_shader = 0;
+  
+  program_cache_store(m_program, m_cache_key);
+  reflect();
+  m_ready = true;
+  
+  for (std::function<void(shader_t&)>& fn : m_on_ready) {
+    fn(*this);
+  }
+  
+  m_on_ready.clear();
+}
+
+static GLuint s_current_program = 0;
+
+static void shader_use(GLuint program) {
+  if (s_current_program != program) {
+    glUseProgram(program);
+    s_current_program = program;
+  }
+}
+
+void shader_t::reflect() {
+  static char name[256];
+  
+  int num_uniforms = 0;
+  glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &num_uniforms);
+  
+  for (int i = 0; i < num_uniforms; i++) {
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(m_program, i, sizeof(name), NULL, &size, &type, name);
+    
+    GLint location = glGetUniformLocation(m_program, name);
+    if (location < 0) continue;
+    
+    std::string key = name;
+    if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0) {
+      key.resize(key.size() - 3);
+    }
+    
+    m_uniforms[key] = location;
+  }
+  
+  int num_blocks = 0;
+  glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_BLOCKS, &num_blocks);
+  
+  for (int i = 0; i < num_blocks; i++) {
+    glGetActiveUniformBlockName(m_program, i, sizeof(name), NULL, name);
+    m_uniform_blocks[name] = i;
+  }
 }
 
 void shader_t::bind() const {
-  glUseProgram(m_program);
+  shader_use(m_program);
+}
+
+uniform_t shader_t::get_uniform(const char* name) const {
+  auto it = m_uniforms.find(name);
+  return it != m_uniforms.end() ? uniform_t(m_program, it->second) : uniform_t(m_program, -1);
+}
+
+GLuint shader_t::get_uniform_block(const char* name) const {
+  auto it = m_uniform_blocks.find(name);
+  return it != m_uniform_blocks.end() ? it->second : GL_INVALID_INDEX;
 }
 
 shader_t& shader_t::uniform_int(const char* name, int value) {
-  bind();
-  GLuint location = glGetUniformLocation(m_program, name);
-  glUniform1i(location, value);
+  get_uniform(name).set(value);
   return *this;
 }
 
 shader_t& shader_t::uniform_float(const char* name, float value) {
-  bind();
-  GLuint location = glGetUniformLocation(m_program, name);
-  glUniform1f(location, value);
+  get_uniform(name).set(value);
   return *this;
 }
 
 shader_t& shader_t::uniform_vec3(const char* name, vec3 value) {
-  bind();
-  GLuint location = glGetUniformLocation(m_program, name);
-  glUniform3f(location, value.x, value.y, value.z);
+  get_uniform(name).set(value);
   return *this;
 }
 
 shader_t& shader_t::uniform_vec3_array(const char* name, std::vector<vec3> value) {
-  bind();
-  GLuint location = glGetUniformLocation(m_program, name);
-  glUniform3fv(location, value.size(), (float*) value.data());
+  get_uniform(name).set(value);
   return *this;
 }
 
@@ -68,10 +200,74 @@ GLuint shader_t::get_program() const {
   return m_program;
 }
 
+shader_t::shader_t(shader_t&& other)
+  : m_program(other.m_program),
+    m_vertex_shader(other.m_vertex_shader),
+    m_fragment_shader(other.m_fragment_shader),
+    m_vertex_key(other.m_vertex_key),
+    m_fragment_key(other.m_fragment_key),
+    m_cache_key(other.m_cache_key),
+    m_ready(other.m_ready),
+    m_on_ready(std::move(other.m_on_ready)),
+    m_uniforms(std::move(other.m_uniforms)),
+    m_uniform_blocks(std::move(other.m_uniform_blocks))
+{
+  // the moved-from shader no longer owns the program or the shared shaders
+  other.m_program = 0;
+  other.m_vertex_shader = 0;
+  other.m_fragment_shader = 0;
+}
+
 shader_t::~shader_t() {
+  if (s_current_program == m_program) {
+    s_current_program = 0;
+  }
+  
+  if (m_vertex_shader) shader_release(m_vertex_key);
+  if (m_fragment_shader) shader_release(m_fragment_key);
+  
   glDeleteProgram(m_program);
 }
 
+uniform_t::uniform_t(GLuint program, GLint location) {
+  m_program = program;
+  m_location = location;
+}
+
+uniform_t::uniform_t() : uniform_t(0, -1) {
+  
+}
+
+bool uniform_t::is_valid() const {
+  return m_location >= 0;
+}
+
+// uniforms are per-program state in GLES 3.0, so the program must be current,
+// but it is only rebound when another program was used in between
+void uniform_t::set(int value) const {
+  if (m_location < 0) return;
+  shader_use(m_program);
+  glUniform1i(m_location, value);
+}
+
+void uniform_t::set(float value) const {
+  if (m_location < 0) return;
+  shader_use(m_program);
+  glUniform1f(m_location, value);
+}
+
+void uniform_t::set(vec3 value) const {
+  if (m_location < 0) return;
+  shader_use(m_program);
+  glUniform3f(m_location, value.x, value.y, value.z);
+}
+
+void uniform_t::set(const std::vector<vec3>& value) const {
+  if (m_location < 0) return;
+  shader_use(m_program);
+  glUniform3fv(m_location, value.size(), (float*) value.data());
+}
+
 GLuint shader_compile(GLuint type, const char* src) {
   const char *all[] = {
     "#version 300 es\n",
@@ -81,39 +277,188 @@ GLuint shader_compile(GLuint type, const char* src) {
   
   GLuint shader = glCreateShader(type);
   glShaderSource(shader, 3, all, NULL);
+  glCompileShader(shader);
+  
+  return shader;
+}
+
+struct shader_object_t {
+  GLuint shader;
+  int refs;
+};
+
+// Programs built from the same stage source share one compiled shader
+// object. It is deleted once the last program using it has linked.
+static std::unordered_map<uint64_t, shader_object_t> s_shader_objects;
+
+GLuint shader_acquire(GLuint type, const std::string& src, uint64_t& key) {
+  key = hash_string(src, hash_bytes(&type, sizeof(type)));
   
+  auto it = s_shader_objects.find(key);
+  if (it != s_shader_objects.end()) {
+    it->second.refs++;
+    return it->second.shader;
+  }
+  
+  GLuint shader = shader_compile(type, src.c_str());
+  s_shader_objects[key] = { shader, 1 };
+  return shader;
+}
+
+void shader_release(uint64_t key) {
+  auto it = s_shader_objects.find(key);
+  if (it == s_shader_objects.end()) return;
+  
+  if (--it->second.refs == 0) {
+    glDeleteShader(it->second.shader);
+    s_shader_objects.erase(it);
+  }
+}
+
+void shader_check(GLuint shader) {
   int success;
-  glCompileShader(shader);
   glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
   
   if (!success) {
     static GLchar info[1024];
     glGetShaderInfoLog(shader, sizeof(info), NULL, info);
     std::cerr << "error: shader_compile: " << info;
+    shader_print_sources();
     throw std::runtime_error("failed to compile shader");
   }
+}
+
+struct shader_source_t {
+  std::string name;
+  std::filesystem::path dir;
+  std::string text;
+};
+
+// a deque so shader_expand can keep pointing into a source's text while the
+// includes it reaches are appended
+static std::deque<shader_source_t> s_sources;
+static std::unordered_map<std::string, int> s_source_ids;
+
+static int shader_source_id(const std::filesystem::path& path) {
+  std::string name = path.lexically_normal().generic_string();
+  
+  auto it = s_source_ids.find(name);
+  if (it != s_source_ids.end()) {
+    return it->second;
+  }
   
-  return shader;
+  std::ifstream in(name, std::ios::binary);
+  if (!in) {
+    std::cerr << "error: " << name << ": could not open shader source" << std::endl;
+    throw std::runtime_error("failed to read shader source");
+  }
+  
+  shader_source_t source;
+  source.name = name;
+  source.dir = std::filesystem::path(name).parent_path();
+  source.text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  
+  int id = (int) s_sources.size();
+  s_sources.push_back(std::move(source));
+  s_source_ids[name] = id;
+  
+  return id;
 }
 
-std::stringstream shader_read_source(const char* src) {
-  std::stringstream ss;
-  std::ifstream in = std::ifstream(src);
+static const char* skip_space(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  return p;
+}
+
+static const char* skip_word(const char* p, const char* end, const char* word) {
+  while (*word) {
+    if (p >= end || *p != *word) return nullptr;
+    p++;
+    word++;
+  }
+  
+  return p;
+}
+
+// matches: #pragma use "file" or #pragma use <file>
+static bool shader_parse_use(const char* p, const char* end, std::string_view& file) {
+  p = skip_space(p, end);
+  if (!(p = skip_word(p, end, "#"))) return false;
+  p = skip_space(p, end);
+  if (!(p = skip_word(p, end, "pragma"))) return false;
+  p = skip_space(p, end);
+  if (!(p = skip_word(p, end, "use"))) return false;
+  p = skip_space(p, end);
+  
+  if (p >= end || (*p != '"' && *p != '<')) return false;
   
-  std::string line;
-  while (std::getline(in, line)) {
-    std::regex rgx("^\\s*#\\s*pragma use\\s+[<\"]([^>\"]*)[>\"]\\s*");
-    std::smatch matches;
+  const char* begin = ++p;
+  while (p < end && *p != '"' && *p != '>') p++;
+  if (p >= end) return false;
+  
+  file = std::string_view(begin, p - begin);
+  return true;
+}
 
-    if(std::regex_match(line, matches, rgx)) {
-      std::filesystem::path file(matches.str(1));
-      std::filesystem::path base = std::filesystem::path(src).parent_path();
-      std::filesystem::path full = base / file;
-      ss << shader_read_source(full.u8string().c_str()).rdbuf() << std::endl;
+static void shader_expand(std::string& out, int id, std::vector<bool>& included) {
+  out += "#line 1 " + std::to_string(id) + "\n";
+  
+  const char* p = s_sources[id].text.data();
+  const char* end = p + s_sources[id].text.size();
+  int line = 1;
+  
+  while (p < end) {
+    const char* eol = (const char*) memchr(p, '\n', end - p);
+    if (!eol) eol = end;
+    
+    std::string_view file;
+    
+    if (shader_parse_use(p, eol, file)) {
+      int include = shader_source_id(s_sources[id].dir / file);
+      
+      if (include >= (int) included.size()) {
+        included.resize(include + 1, false);
+      }
+      
+      if (!included[include]) {
+        included[include] = true;
+        shader_expand(out, include, included);
+        out += "#line " + std::to_string(line + 1) + " " + std::to_string(id) + "\n";
+      } else {
+        out += '\n';
+      }
     } else {
-      ss << line << std::endl;
+      out.append(p, eol);
+      out += '\n';
     }
+    
+    p = eol + 1;
+    line++;
+  }
+}
+
+const char* shader_source_name(int id) {
+  if (id < 0 || id >= (int) s_sources.size()) {
+    return "?";
   }
   
-  return ss;
+  return s_sources[id].name.c_str();
+}
+
+// #line directives name sources by id, so map them back for driver errors
+void shader_print_sources() {
+  for (int id = 0; id < (int) s_sources.size(); id++) {
+    std::cerr << "note: source " << id << " is " << s_sources[id].name << std::endl;
+  }
+}
+
+std::string shader_read_source(const char* src) {
+  int id = shader_source_id(src);
+  
+  std::vector<bool> included(s_sources.size(), false);
+  included[id] = true;
+  
+  std::string out;
+  shader_expand(out, id, included);
+  return out;
 }
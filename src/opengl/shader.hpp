@@ -1,19 +1,56 @@
 #ifndef SHADER_H
 #define SHADER_H
 
-#include <sstream>
+#include <string>
 #include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
 #include <util/math3d.hpp>
 #include <glad/glad.h>
 
+class uniform_t {
+private:
+  GLuint m_program;
+  GLint m_location;
+
+public:
+  uniform_t();
+  uniform_t(GLuint program, GLint location);
+  bool is_valid() const;
+  void set(int value) const;
+  void set(float value) const;
+  void set(vec3 value) const;
+  void set(const std::vector<vec3>& value) const;
+};
+
 class shader_t {
 private:
   GLuint m_program;
+  GLuint m_vertex_shader;
+  GLuint m_fragment_shader;
+  uint64_t m_vertex_key;
+  uint64_t m_fragment_key;
+  uint64_t m_cache_key;
+  bool m_ready;
+  std::vector<std::function<void(shader_t&)>> m_on_ready;
+  std::unordered_map<std::string, GLint> m_uniforms;
+  std::unordered_map<std::string, GLuint> m_uniform_blocks;
+  
+  void reflect();
+  void finalize();
 
 public:
-  shader_t(const std::stringstream& src_vertex, const std::stringstream& src_fragment);
+  shader_t(const std::string& src_vertex, const std::string& src_fragment);
+  shader_t(shader_t&& other);
+  shader_t(const shader_t&) = delete;
   ~shader_t();
+  bool is_ready();
+  void wait();
+  void on_ready(std::function<void(shader_t&)> fn);
   void bind() const;
+  uniform_t get_uniform(const char* name) const;
+  GLuint get_uniform_block(const char* name) const;
   shader_t& uniform_int(const char* name, int value);
   shader_t& uniform_float(const char* name, float value);
   shader_t& uniform_vec3(const char* name, vec3 value);
@@ -21,6 +58,7 @@ public:
   GLuint get_program() const;
 };
 
-std::stringstream shader_read_source(const char* src);
+std::string shader_read_source(const char* src);
+const char* shader_source_name(int id);
 
 #endif
@@ -1,16 +1,10 @@
 #include "texture.hpp"
+#include <util/thread_pool.hpp>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
-#include <SDL2/SDL_image.h>
 
-static GLuint surface_format(SDL_Surface* surface);
-
-texture_t::texture_t(const char *src) {
-  SDL_Surface *surface = IMG_Load(src);
-  if (!surface) {   
-    std::cerr << "error: " << src << ": " << SDL_GetError() << std::endl;
-    throw std::runtime_error("failed to load image");
-  }
-  
+texture_t::texture_t(const texture_source_t& source, const texture_t& placeholder) {
   glGenTextures(1, &m_texture);
   glBindTexture(GL_TEXTURE_2D, m_texture);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -18,17 +12,14 @@ texture_t::texture_t(const char *src) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   
-  glTexImage2D(
-    GL_TEXTURE_2D, 0, GL_RGBA,
-    surface->w, surface->h,
-    0, surface_format(surface), GL_UNSIGNED_BYTE,
-    surface->pixels
-  );
-  
-  glGenerateMipmap(GL_TEXTURE_2D);
-  SDL_FreeSurface(surface);
-  
   m_type = GL_TEXTURE_2D;
+  m_placeholder = &placeholder;
+  m_pixel_buffer = 0;
+  m_level = 0;
+  m_level_rows = 0;
+  m_ready = false;
+  
+  m_load = thread_pool_t::shared().submit([source]() { return texture_cache_import(source); });
 }
 
 texture_t::texture_t(int width, int height, GLuint format, GLuint internalformat, GLuint type, std::vector<unsigned int> data) {
@@ -40,6 +31,11 @@ texture_t::texture_t(int width, int height, GLuint format, GLuint internalformat
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexImage2D(GL_TEXTURE_2D, 0, internalformat, width, height, 0, format, type, data.data());
   m_type = GL_TEXTURE_2D;
+  m_placeholder = nullptr;
+  m_pixel_buffer = 0;
+  m_level = 0;
+  m_level_rows = 0;
+  m_ready = true;
 }
 
 texture_t::texture_t(int width, int height, GLuint format, GLuint internalformat, GLuint type) {
@@ -51,11 +47,117 @@ texture_t::texture_t(int width, int height, GLuint format, GLuint internalformat
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexImage2D(GL_TEXTURE_2D, 0, internalformat, width, height, 0, format, type, NULL);
   m_type = GL_TEXTURE_2D;
+  m_placeholder = nullptr;
+  m_pixel_buffer = 0;
+  m_level = 0;
+  m_level_rows = 0;
+  m_ready = true;
+}
+
+texture_t::texture_t(texture_t&& other)
+  : m_texture(other.m_texture),
+    m_type(other.m_type),
+    m_placeholder(other.m_placeholder),
+    m_load(std::move(other.m_load)),
+    m_image(std::move(other.m_image)),
+    m_pixel_buffer(other.m_pixel_buffer),
+    m_level(other.m_level),
+    m_level_rows(other.m_level_rows),
+    m_ready(other.m_ready)
+{
+  other.m_texture = 0;
+  other.m_pixel_buffer = 0;
+}
+
+bool texture_t::is_ready() const {
+  return m_ready;
+}
+
+void texture_t::begin_upload() {
+  try {
+    m_image = m_load.get();
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << std::endl;
+    throw std::runtime_error("failed to load image");
+  }
+  
+  const texture_level_t& base = m_image.levels[0];
+  
+  glBindTexture(GL_TEXTURE_2D, m_texture);
+  glTexStorage2D(GL_TEXTURE_2D, (GLsizei) m_image.levels.size(), m_image.format, base.width, base.height);
+  
+  glGenBuffers(1, &m_pixel_buffer);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixel_buffer);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, m_image.size(), NULL, GL_STREAM_DRAW);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// Copies up to max_bytes of blocks through the pixel buffer into the texture,
+// a row of blocks at a time, and returns the number of bytes uploaded. Once
+// the last level is in, bind() stops using the placeholder.
+int texture_t::stream(int max_bytes) {
+  if (m_ready || max_bytes <= 0) return 0;
+  
+  if (!m_pixel_buffer) {
+    if (m_load.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return 0;
+    begin_upload();
+  }
+  
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixel_buffer);
+  glBindTexture(GL_TEXTURE_2D, m_texture);
+  
+  int uploaded = 0;
+  int block_size = texture_block_size(m_image.format);
+  
+  while (m_level < (int) m_image.levels.size() && uploaded < max_bytes) {
+    const texture_level_t& level = m_image.levels[m_level];
+    int row_size = (level.width + 3) / 4 * block_size;
+    int block_rows = (level.height + 3) / 4;
+    int rows = std::min(std::max((max_bytes - uploaded) / row_size, 1), block_rows - m_level_rows);
+    
+    GLintptr offset = level.offset + (GLintptr) m_level_rows * row_size;
+    GLsizeiptr size = (GLsizeiptr) rows * row_size;
+    
+    // each range is written exactly once, so there is nothing to synchronise with
+    void* dst = glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, offset, size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+    );
+    memcpy(dst, m_image.data() + offset, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    
+    int y = m_level_rows * 4;
+    glCompressedTexSubImage2D(
+      GL_TEXTURE_2D, m_level,
+      0, y, level.width, std::min(rows * 4, level.height - y),
+      m_image.format, (GLsizei) size,
+      (const void*) offset
+    );
+    
+    uploaded += (int) size;
+    m_level_rows += rows;
+    
+    if (m_level_rows == block_rows) {
+      m_level++;
+      m_level_rows = 0;
+    }
+  }
+  
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  
+  if (m_level == (int) m_image.levels.size()) {
+    glDeleteBuffers(1, &m_pixel_buffer);
+    m_pixel_buffer = 0;
+    m_image = texture_image_t();
+    m_ready = true;
+  }
+  
+  return uploaded;
 }
 
 void texture_t::bind(int channel) {
   glActiveTexture(GL_TEXTURE0 + channel);
-  glBindTexture(m_type, m_texture);
+  glBindTexture(m_type, m_ready ? m_texture : m_placeholder->m_texture);
 }
 
 GLuint texture_t::get_texture() const {
@@ -64,15 +166,5 @@ GLuint texture_t::get_texture() const {
 
 texture_t::~texture_t() {
   glDeleteTextures(1, &m_texture);
-}
-
-GLuint surface_format(SDL_Surface* surface) {
-  switch (surface->format->BytesPerPixel) {
-  case 3:
-    return GL_RGB;
-  case 4:
-    return GL_RGBA;
-  default:
-    throw std::runtime_error("unknown surface format");
-  }
+  glDeleteBuffers(1, &m_pixel_buffer);
 }
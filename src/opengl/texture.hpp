@@ -2,18 +2,35 @@
 #define TEXTURE_H
 
 #include <glad/glad.h>
+#include <opengl/texture_cache.hpp>
+#include <future>
 #include <vector>
 
 class texture_t {
 private:
   GLuint m_texture;
   GLuint m_type;
+  const texture_t* m_placeholder;
+  std::future<texture_image_t> m_load;
+  texture_image_t m_image;
+  GLuint m_pixel_buffer;
+  int m_level;
+  int m_level_rows;
+  bool m_ready;
+  
+  void begin_upload();
 
 public:
-  texture_t(const char *src);
+  // Loads the compressed mip chain of source on the shared thread pool. Until
+  // stream() has uploaded all of it, bind() binds the placeholder instead.
+  texture_t(const texture_source_t& source, const texture_t& placeholder);
   texture_t(int width, int height, GLuint format, GLuint internalformat, GLuint type, std::vector<unsigned int> data);
   texture_t(int width, int height, GLuint format, GLuint internalformat, GLuint type);
+  texture_t(texture_t&& other);
+  texture_t(const texture_t&) = delete;
   ~texture_t();
+  bool is_ready() const;
+  int stream(int max_bytes);
   void bind(int channel);
   GLuint get_texture() const;
 };
@@ -0,0 +1,452 @@
+#include "texture_cache.hpp"
+#include <util/etc.hpp>
+#include <util/hash.hpp>
+#include <util/thread_pool.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <SDL2/SDL_image.h>
+
+#define TEXTURE_CACHE_DIR "cache/textures"
+
+// bump when the encoders or mip filters change so stale entries are rebuilt
+static const uint32_t TEXTURE_CACHE_VERSION = 3;
+
+// occlusion, roughness and metalness of materials without those maps, as
+// gbuffer.frag used before it read them
+static const unsigned char ORM_DEFAULTS[3] = { 255, 255, 13 };
+
+static const unsigned char KTX_IDENTIFIER[12] = { 0xab, 'K', 'T', 'X', ' ', '1', '1', 0xbb, '\r', '\n', 0x1a, '\n' };
+static const uint32_t KTX_ENDIANNESS = 0x04030201;
+static const char KTX_SOURCE_KEY[] = "nui.source";
+
+// KTX 1.1. The source stamp is stored as a key/value pair, followed by each
+// level as a 32-bit size and its blocks.
+class ktx_header_t {
+public:
+  unsigned char identifier[12];
+  uint32_t endianness;
+  uint32_t gl_type;
+  uint32_t gl_type_size;
+  uint32_t gl_format;
+  uint32_t gl_internal_format;
+  uint32_t gl_base_internal_format;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t array_elements;
+  uint32_t faces;
+  uint32_t mip_levels;
+  uint32_t key_value_bytes;
+};
+
+class texture_cache_stamp_t {
+public:
+  uint64_t sources;
+  uint32_t version;
+  uint32_t usage;
+};
+
+static const uint32_t KTX_SOURCE_ENTRY_SIZE = sizeof(KTX_SOURCE_KEY) + sizeof(texture_cache_stamp_t);
+static const uint32_t KTX_KEY_VALUE_BYTES = (4 + KTX_SOURCE_ENTRY_SIZE + 3) & ~3u;
+
+static_assert(sizeof(ktx_header_t) == 64, "ktx header must be packed");
+
+const unsigned char* texture_image_t::data() const {
+  return file ? (const unsigned char*) file->data() : blocks.data();
+}
+
+size_t texture_image_t::size() const {
+  return levels.empty() ? 0 : levels.back().offset + levels.back().size;
+}
+
+GLenum texture_usage_format(texture_usage_t usage) {
+  switch (usage) {
+  case TEXTURE_COLOR:
+    return GL_COMPRESSED_RGB8_ETC2;
+  case TEXTURE_NORMAL:
+    return GL_COMPRESSED_RG11_EAC;
+  case TEXTURE_ORM:
+    return GL_COMPRESSED_RGB8_ETC2;
+  default:
+    throw std::runtime_error("unknown texture usage");
+  }
+}
+
+static GLenum texture_base_format(GLenum format) {
+  switch (format) {
+  case GL_COMPRESSED_RG11_EAC:
+    return GL_RG;
+  default:
+    return GL_RGB;
+  }
+}
+
+int texture_block_size(GLenum format) {
+  return format == GL_COMPRESSED_RG11_EAC ? 16 : 8;
+}
+
+static std::filesystem::path texture_cache_path(const texture_source_t& source) {
+  char name[32];
+  uint64_t key = hash_bytes(&source.usage, sizeof(source.usage));
+  for (const std::string& path : source.paths) {
+    key = hash_string(path, key);
+  }
+  snprintf(name, sizeof(name), "%016llx.ktx", (unsigned long long) key);
+  return std::filesystem::path(TEXTURE_CACHE_DIR) / name;
+}
+
+// the modification time and size of every image, hashed together
+static bool texture_cache_stamp(const texture_source_t& source, texture_cache_stamp_t& stamp) {
+  stamp.sources = HASH_SEED;
+  
+  for (const std::string& path : source.paths) {
+    if (path.empty()) continue;
+    
+    std::error_code error;
+    std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+    if (error) return false;
+    
+    uint64_t size = std::filesystem::file_size(path, error);
+    if (error) return false;
+    
+    int64_t mtime = time.time_since_epoch().count();
+    stamp.sources = hash_bytes(&mtime, sizeof(mtime), stamp.sources);
+    stamp.sources = hash_bytes(&size, sizeof(size), stamp.sources);
+  }
+  
+  stamp.version = TEXTURE_CACHE_VERSION;
+  stamp.usage = source.usage;
+  return true;
+}
+
+bool texture_cache_load(const texture_source_t& source, texture_image_t& image) {
+  std::filesystem::path path = texture_cache_path(source);
+  
+  std::error_code error;
+  if (!std::filesystem::exists(path, error)) return false;
+  
+  texture_cache_stamp_t stamp;
+  if (!texture_cache_stamp(source, stamp)) return false;
+  
+  std::unique_ptr<mapped_file_t> file = std::make_unique<mapped_file_t>(path.string());
+  if (file->size() < sizeof(ktx_header_t) + KTX_KEY_VALUE_BYTES) return false;
+  
+  ktx_header_t header;
+  memcpy(&header, file->data(), sizeof(header));
+  
+  GLenum format = texture_usage_format(source.usage);
+  
+  if (
+    memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0 ||
+    header.endianness != KTX_ENDIANNESS ||
+    header.gl_internal_format != format ||
+    header.pixel_width == 0 ||
+    header.pixel_height == 0 ||
+    header.pixel_depth != 0 ||
+    header.array_elements != 0 ||
+    header.faces != 1 ||
+    header.mip_levels == 0 ||
+    header.mip_levels > 32 ||
+    header.key_value_bytes != KTX_KEY_VALUE_BYTES
+  ) {
+    return false;
+  }
+  
+  const char* entry = file->data() + sizeof(ktx_header_t);
+  uint32_t entry_size;
+  memcpy(&entry_size, entry, sizeof(entry_size));
+  
+  texture_cache_stamp_t cached;
+  memcpy(&cached, entry + 4 + sizeof(KTX_SOURCE_KEY), sizeof(cached));
+  
+  if (
+    entry_size != KTX_SOURCE_ENTRY_SIZE ||
+    memcmp(entry + 4, KTX_SOURCE_KEY, sizeof(KTX_SOURCE_KEY)) != 0 ||
+    memcmp(&cached, &stamp, sizeof(stamp)) != 0
+  ) {
+    return false;
+  }
+  
+  // levels are uploaded straight from the mapping, so their offsets are
+  // into the file
+  size_t offset = sizeof(ktx_header_t) + KTX_KEY_VALUE_BYTES;
+  int block_size = texture_block_size(format);
+  
+  image.format = format;
+  image.levels.clear();
+  
+  for (uint32_t level = 0; level < header.mip_levels; level++) {
+    uint32_t size;
+    if (offset + sizeof(size) > file->size()) return false;
+    memcpy(&size, file->data() + offset, sizeof(size));
+    offset += sizeof(size);
+    
+    int width = std::max(1, (int) (header.pixel_width >> level));
+    int height = std::max(1, (int) (header.pixel_height >> level));
+    size_t expected_size = (size_t) ((width + 3) / 4) * ((height + 3) / 4) * block_size;
+    
+    if (size != expected_size || offset + size > file->size()) return false;
+    
+    image.levels.push_back({ width, height, offset, size });
+    offset += size;
+  }
+  
+  if (offset != file->size()) return false;
+  
+  image.file = std::move(file);
+  image.blocks.clear();
+  return true;
+}
+
+void texture_cache_store(const texture_source_t& source, const texture_image_t& image) {
+  texture_cache_stamp_t stamp;
+  if (!texture_cache_stamp(source, stamp)) return;
+  
+  ktx_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+  header.endianness = KTX_ENDIANNESS;
+  header.gl_type_size = 1;
+  header.gl_internal_format = image.format;
+  header.gl_base_internal_format = texture_base_format(image.format);
+  header.pixel_width = image.levels[0].width;
+  header.pixel_height = image.levels[0].height;
+  header.faces = 1;
+  header.mip_levels = (uint32_t) image.levels.size();
+  header.key_value_bytes = KTX_KEY_VALUE_BYTES;
+  
+  char key_value[KTX_KEY_VALUE_BYTES] = {};
+  uint32_t entry_size = KTX_SOURCE_ENTRY_SIZE;
+  memcpy(key_value, &entry_size, sizeof(entry_size));
+  memcpy(key_value + 4, KTX_SOURCE_KEY, sizeof(KTX_SOURCE_KEY));
+  memcpy(key_value + 4 + sizeof(KTX_SOURCE_KEY), &stamp, sizeof(stamp));
+  
+  std::error_code error;
+  std::filesystem::create_directories(TEXTURE_CACHE_DIR, error);
+  
+  std::filesystem::path path = texture_cache_path(source);
+  std::filesystem::path tmp_path = path;
+  tmp_path += ".tmp";
+  
+  {
+    std::ofstream out(tmp_path, std::ios::binary);
+    if (!out) {
+      std::cerr << "warning: texture_cache_store: could not write " << tmp_path << std::endl;
+      return;
+    }
+    
+    out.write((const char*) &header, sizeof(header));
+    out.write(key_value, sizeof(key_value));
+    
+    // block sizes are multiples of 8, so levels never need padding
+    for (const texture_level_t& level : image.levels) {
+      uint32_t size = (uint32_t) level.size;
+      out.write((const char*) &size, sizeof(size));
+      out.write((const char*) image.data() + level.offset, level.size);
+    }
+  }
+  
+  std::filesystem::rename(tmp_path, path, error);
+}
+
+static std::vector<unsigned char> decode_image(const std::string& source_path, int& width, int& height) {
+  SDL_Surface *surface = IMG_Load(source_path.c_str());
+  if (!surface) {
+    throw std::runtime_error(source_path + ": " + SDL_GetError());
+  }
+  
+  SDL_Surface *rgba = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+  SDL_FreeSurface(surface);
+  if (!rgba) {
+    throw std::runtime_error(source_path + ": " + SDL_GetError());
+  }
+  
+  width = rgba->w;
+  height = rgba->h;
+  std::vector<unsigned char> pixels((size_t) width * height * 4);
+  
+  SDL_LockSurface(rgba);
+  for (int y = 0; y < height; y++) {
+    memcpy(
+      &pixels[(size_t) y * width * 4],
+      (const unsigned char*) rgba->pixels + (size_t) y * rgba->pitch,
+      width * 4
+    );
+  }
+  SDL_UnlockSurface(rgba);
+  SDL_FreeSurface(rgba);
+  
+  return pixels;
+}
+
+// 2x2 box filter. Normals are averaged as vectors and renormalised, so
+// distant mips keep unit length instead of flattening towards the surface.
+static std::vector<unsigned char> downsample(const std::vector<unsigned char>& src, int width, int height, texture_usage_t usage) {
+  int next_width = std::max(1, width / 2);
+  int next_height = std::max(1, height / 2);
+  std::vector<unsigned char> dst((size_t) next_width * next_height * 4);
+  
+  for (int y = 0; y < next_height; y++) {
+    for (int x = 0; x < next_width; x++) {
+      float sum[4] = {};
+      
+      for (int k = 0; k < 4; k++) {
+        int sx = std::min(x * 2 + (k & 1), width - 1);
+        int sy = std::min(y * 2 + (k >> 1), height - 1);
+        const unsigned char* texel = &src[((size_t) sy * width + sx) * 4];
+        
+        for (int c = 0; c < 4; c++) {
+          sum[c] += texel[c] / 4.0f;
+        }
+      }
+      
+      if (usage == TEXTURE_NORMAL) {
+        float n[3];
+        for (int c = 0; c < 3; c++) n[c] = sum[c] / 127.5f - 1.0f;
+        
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0f) {
+          for (int c = 0; c < 3; c++) sum[c] = (n[c] / length + 1.0f) * 127.5f;
+        }
+      }
+      
+      unsigned char* texel = &dst[((size_t) y * next_width + x) * 4];
+      for (int c = 0; c < 4; c++) {
+        texel[c] = (unsigned char) std::min(255.0f, sum[c] + 0.5f);
+      }
+    }
+  }
+  
+  return dst;
+}
+
+static void encode_level(const std::vector<unsigned char>& pixels, int width, int height, texture_usage_t usage, unsigned char* blocks) {
+  int blocks_x = (width + 3) / 4;
+  int blocks_y = (height + 3) / 4;
+  int block_size = texture_block_size(texture_usage_format(usage));
+  thread_pool_t& thread_pool = thread_pool_t::shared();
+  
+  thread_pool.parallel_for(blocks_y, thread_pool.size() + 1, [&](int, int begin, int end) {
+    unsigned char texels[64];
+    
+    for (int by = begin; by < end; by++) {
+      for (int bx = 0; bx < blocks_x; bx++) {
+        // edge blocks of levels smaller than a block repeat the last texel
+        for (int i = 0; i < 16; i++) {
+          int x = std::min(bx * 4 + i % 4, width - 1);
+          int y = std::min(by * 4 + i / 4, height - 1);
+          memcpy(&texels[i * 4], &pixels[((size_t) y * width + x) * 4], 4);
+        }
+        
+        unsigned char* block = &blocks[((size_t) by * blocks_x + bx) * block_size];
+        
+        switch (usage) {
+        case TEXTURE_COLOR:
+        case TEXTURE_ORM:
+          etc2_encode_rgb(texels, block);
+          break;
+        case TEXTURE_NORMAL:
+          eac_encode_r11(texels, 0, block);
+          eac_encode_r11(texels, 1, block + 8);
+          break;
+        }
+      }
+    }
+  });
+}
+
+// Occlusion, roughness and metalness each come from the red channel of their
+// map, or the default where a material has none.
+static std::vector<unsigned char> pack_orm(const texture_source_t& source, int& width, int& height) {
+  std::vector<unsigned char> pixels;
+  width = height = 0;
+  
+  for (int channel = 0; channel < 3; channel++) {
+    const std::string& path = channel < (int) source.paths.size() ? source.paths[channel] : std::string();
+    if (path.empty()) continue;
+    
+    int map_width, map_height;
+    std::vector<unsigned char> map = decode_image(path, map_width, map_height);
+    
+    if (pixels.empty()) {
+      width = map_width;
+      height = map_height;
+      pixels.resize((size_t) width * height * 4);
+      
+      for (size_t i = 0; i < pixels.size(); i += 4) {
+        memcpy(&pixels[i], ORM_DEFAULTS, 3);
+        pixels[i + 3] = 255;
+      }
+    } else if (map_width != width || map_height != height) {
+      throw std::runtime_error(path + ": size does not match the other channel maps");
+    }
+    
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+      pixels[i + channel] = map[i];
+    }
+  }
+  
+  if (pixels.empty()) {
+    width = height = 1;
+    pixels = { ORM_DEFAULTS[0], ORM_DEFAULTS[1], ORM_DEFAULTS[2], 255 };
+  }
+  
+  return pixels;
+}
+
+static texture_image_t transcode_image(const texture_source_t& source) {
+  texture_usage_t usage = source.usage;
+  int width, height;
+  std::vector<unsigned char> pixels =
+    usage == TEXTURE_ORM ? pack_orm(source, width, height) : decode_image(source.paths.at(0), width, height);
+  
+  // surface properties vary far more slowly than colour or normals, so ORM
+  // textures drop their top level and cost a quarter of their source
+  if (usage == TEXTURE_ORM && (width > 1 || height > 1)) {
+    pixels = downsample(pixels, width, height, usage);
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+  }
+  
+  texture_image_t image;
+  image.format = texture_usage_format(usage);
+  int block_size = texture_block_size(image.format);
+  
+  size_t offset = 0;
+  for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+    size_t size = (size_t) ((w + 3) / 4) * ((h + 3) / 4) * block_size;
+    image.levels.push_back({ w, h, offset, size });
+    offset += size;
+    if (w == 1 && h == 1) break;
+  }
+  
+  image.blocks.resize(offset);
+  
+  for (size_t level = 0; level < image.levels.size(); level++) {
+    const texture_level_t& info = image.levels[level];
+    if (level > 0) {
+      const texture_level_t& parent = image.levels[level - 1];
+      pixels = downsample(pixels, parent.width, parent.height, usage);
+    }
+    
+    encode_level(pixels, info.width, info.height, usage, &image.blocks[info.offset]);
+  }
+  
+  return image;
+}
+
+texture_image_t texture_cache_import(const texture_source_t& source) {
+  texture_image_t image;
+  if (texture_cache_load(source, image)) {
+    return image;
+  }
+  
+  image = transcode_image(source);
+  texture_cache_store(source, image);
+  
+  return image;
+}
@@ -0,0 +1,67 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+#include <util/mapped_file.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+// What a texture holds decides its compressed format and how its mips are
+// filtered.
+enum texture_usage_t {
+  TEXTURE_COLOR,  // ETC2 RGB8
+  TEXTURE_NORMAL, // EAC RG11 of x and y, z is reconstructed in the shader
+  TEXTURE_ORM     // ETC2 RGB8 of occlusion, roughness and metalness, at half size
+};
+
+// The images a texture is built from. Colour and normal textures take one
+// image. ORM textures pack the red channel of an occlusion, a roughness and
+// a metalness map, and fill a channel with its default where the path is
+// empty.
+class texture_source_t {
+public:
+  texture_usage_t usage;
+  std::vector<std::string> paths;
+  
+  texture_source_t(texture_usage_t _usage, std::vector<std::string> _paths)
+    : usage(_usage),
+      paths(std::move(_paths))
+    {}
+};
+
+class texture_level_t {
+public:
+  int width;
+  int height;
+  size_t offset;
+  size_t size;
+};
+
+// A compressed mip chain, either transcoded into blocks or mapped straight
+// from the cache. Level offsets are relative to data(), which for a mapped
+// entry is the start of the file.
+class texture_image_t {
+public:
+  GLenum format;
+  std::vector<texture_level_t> levels;
+  std::vector<unsigned char> blocks;
+  std::unique_ptr<mapped_file_t> file;
+  
+  const unsigned char* data() const;
+  size_t size() const;
+};
+
+GLenum texture_usage_format(texture_usage_t usage);
+int texture_block_size(GLenum format);
+
+// Maps the cached mip chain of source. Returns false if there is no entry,
+// or if any of the images or the encoder has changed since it was written.
+bool texture_cache_load(const texture_source_t& source, texture_image_t& image);
+void texture_cache_store(const texture_source_t& source, const texture_image_t& image);
+
+// Loads the cached mip chain of a source, decoding, packing, filtering and
+// transcoding it on a miss. Safe to call from worker threads.
+texture_image_t texture_cache_import(const texture_source_t& source);
+
+#endif
@@ -17,8 +17,8 @@ void uniform_buffer_t::sub(void* data, int offset, int size) {
 }
 
 void uniform_buffer_t::attach_shader(const shader_t& shader) {
-  shader.bind();
-  GLuint location = glGetUniformBlockIndex(shader.get_program(), m_name);
+  GLuint location = shader.get_uniform_block(m_name);
+  if (location == GL_INVALID_INDEX) return;
   glUniformBlockBinding(shader.get_program(), location, m_binding);
 }
 
@@ -2,6 +2,10 @@
 #define VERTEX_H
 
 #include <util/math3d.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
 
 class vertex_t {
 public:
@@ -11,6 +15,8 @@ public:
   vec3 bitangent;
   vec2 uv;
   
+  inline vertex_t() {}
+  
   inline vertex_t(vec3 pos_, vec3 _normal, vec2 uv_)
     : pos(pos_),
       normal(_normal),
@@ -21,9 +27,129 @@ public:
     : pos(pos_),
       normal(_normal),
       tangent(_tangent),
-      bitangent(_tangent),
+      bitangent(_bitangent),
       uv(uv_)
     {}
 };
 
+inline uint16_t pack_half(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  
+  uint32_t sign = (x >> 16) & 0x8000;
+  int exponent = (int) ((x >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = x & 0x7fffff;
+  
+  if (exponent <= 0) return sign;
+  if (exponent >= 31) return sign | 0x7c00;
+  
+  // round to nearest, a carry into the exponent is still correct
+  return sign | (((exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+}
+
+inline uint32_t pack_snorm_2_10_10_10(vec3 v, float w) {
+  auto snorm10 = [](float f) {
+    f = std::max(-1.0f, std::min(1.0f, f));
+    return (uint32_t) ((int) roundf(f * 511.0f) & 0x3ff);
+  };
+  
+  uint32_t w2 = (uint32_t) ((int) roundf(std::max(-1.0f, std::min(1.0f, w))) & 0x3);
+  
+  return snorm10(v.x) | (snorm10(v.y) << 10) | (snorm10(v.z) << 20) | (w2 << 30);
+}
+
+// GPU vertex layout, 20 bytes:
+//   pos      4 x unorm16, relative to the mesh bounds (w unused)
+//   normal   snorm 10-10-10-2
+//   tangent  snorm 10-10-10-2, w holds the bitangent handedness
+//   uv       2 x half
+class packed_vertex_t {
+public:
+  uint16_t pos[4];
+  uint32_t normal;
+  uint32_t tangent;
+  uint16_t uv[2];
+  
+  inline static packed_vertex_t pack(const vertex_t& vertex, vec3 bounds_min, vec3 bounds_scale) {
+    packed_vertex_t packed;
+    
+    vec3 p = vertex.pos - bounds_min;
+    float q[3] = { p.x / bounds_scale.x, p.y / bounds_scale.y, p.z / bounds_scale.z };
+    
+    for (int i = 0; i < 3; i++) {
+      packed.pos[i] = (uint16_t) roundf(std::max(0.0f, std::min(1.0f, q[i])) * 65535.0f);
+    }
+    
+    packed.pos[3] = 0;
+    
+    vec3 n = vertex.normal;
+    vec3 t = vertex.tangent;
+    
+    // Gram-Schmidt so the shader can rebuild the bitangent from cross(N, T)
+    t = t - n * vec3::dot(n, t);
+    t = t.length_squared() > 0.0f ? t.normalize() : vec3(1, 0, 0);
+    
+    float handedness = vec3::dot(vec3::cross(n, t), vertex.bitangent) < 0.0f ? -1.0f : 1.0f;
+    
+    packed.normal = pack_snorm_2_10_10_10(n, 0.0f);
+    packed.tangent = pack_snorm_2_10_10_10(t, handedness);
+    packed.uv[0] = pack_half(vertex.uv.x);
+    packed.uv[1] = pack_half(vertex.uv.y);
+    
+    return packed;
+  }
+};
+
+static_assert(sizeof(packed_vertex_t) == 20, "packed_vertex_t must stay 20 bytes");
+
+// bump whenever packed_vertex_t or the meaning of its fields changes, so
+// cached meshes built with the old layout are rebuilt
+static const uint32_t VERTEX_FORMAT_VERSION = 1;
+
+static const int MAX_MESH_LODS = 4;
+
+// A range of a mesh's indices and its object-space simplification error.
+class mesh_lod_t {
+public:
+  int index_offset;
+  int index_count;
+  float error;
+};
+
+class mesh_data_t {
+public:
+  std::vector<packed_vertex_t> vertices;
+  std::vector<unsigned short> indices;
+  std::vector<mesh_lod_t> lods;
+  vec3 bounds_min;
+  vec3 bounds_scale;
+  
+  inline mesh_data_t() : bounds_min(0.0), bounds_scale(1.0) {}
+};
+
+// Non-owning view of finished mesh data, e.g. straight out of a mapped file.
+class mesh_view_t {
+public:
+  const packed_vertex_t* vertices;
+  int vertex_count;
+  const unsigned short* indices;
+  int index_count;
+  const mesh_lod_t* lods;
+  int lod_count;
+  vec3 bounds_min;
+  vec3 bounds_scale;
+  
+  inline mesh_view_t()
+    : vertices(nullptr), vertex_count(0),
+      indices(nullptr), index_count(0),
+      lods(nullptr), lod_count(0),
+      bounds_min(0.0), bounds_scale(1.0) {}
+  
+  inline mesh_view_t(const mesh_data_t& mesh_data)
+    : vertices(mesh_data.vertices.data()), vertex_count((int) mesh_data.vertices.size()),
+      indices(mesh_data.indices.data()), index_count((int) mesh_data.indices.size()),
+      lods(mesh_data.lods.data()), lod_count((int) mesh_data.lods.size()),
+      bounds_min(mesh_data.bounds_min), bounds_scale(mesh_data.bounds_scale) {}
+};
+
 #endif
@@ -1,67 +1,328 @@
 #include "vertex_buffer.hpp"
+#include <cstddef>
 #include <iostream>
 
-vertex_buffer_t::vertex_buffer_t(int max_vertices) {
-  glGenVertexArrays(1, &m_vao);
-  glBindVertexArray(m_vao);
+static const int MAX_PAGE_VERTICES = 65536;
+
+static GLuint s_bound_vao = 0;
+
+static void vertex_array_bind(GLuint vao) {
+  if (s_bound_vao != vao) {
+    glBindVertexArray(vao);
+    s_bound_vao = vao;
+  }
+}
+
+vertex_page_t::vertex_page_t(int max_vertices, int max_indices)
+  : vertices(max_vertices),
+    indices(max_indices) {
+  glGenVertexArrays(1, &vao);
+  vertex_array_bind(vao);
+  
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, max_vertices * sizeof(packed_vertex_t), 0, GL_STATIC_DRAW);
   
-  glGenBuffers(1, &m_vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-  glBufferData(GL_ARRAY_BUFFER, max_vertices * sizeof(vertex_t), 0, GL_STATIC_DRAW);
+  glGenBuffers(1, &ibo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_indices * sizeof(unsigned short), 0, GL_STATIC_DRAW);
   
   glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (float*) 0);
+  glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(packed_vertex_t), (void*) offsetof(packed_vertex_t, pos));
   glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (float*) 0 + 3);
+  glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(packed_vertex_t), (void*) offsetof(packed_vertex_t, normal));
   glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (float*) 0 + 6);
+  glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(packed_vertex_t), (void*) offsetof(packed_vertex_t, tangent));
   glEnableVertexAttribArray(3);
-  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (float*) 0 + 9);
-  glEnableVertexAttribArray(4);
-  glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (float*) 0 + 12);
+  glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(packed_vertex_t), (void*) offsetof(packed_vertex_t, uv));
+  
+  num_allocations = 0;
+}
+
+vertex_page_t::~vertex_page_t() {
+  if (s_bound_vao == vao) {
+    s_bound_vao = 0;
+  }
+  
+  glDeleteVertexArrays(1, &vao);
+  glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &ibo);
+}
+
+vertex_buffer_t::vertex_buffer_t(int page_vertices, int page_indices) {
+  if (page_vertices > MAX_PAGE_VERTICES) {
+    throw std::runtime_error("vertex buffer too large for 16-bit indices");
+  }
   
-  m_offset = 0;
-  m_max_vertices = max_vertices;
+  m_page_vertices = page_vertices;
+  m_page_indices = page_indices;
+  m_pages.push_back(std::make_unique<vertex_page_t>(page_vertices, page_indices));
 }
 
 void vertex_buffer_t::bind() {
-  glBindVertexArray(m_vao);
+  vertex_array_bind(m_pages[0]->vao);
 }
 
-mesh_t vertex_buffer_t::push(std::vector<vertex_t> vertices) {
-  if (m_offset + (int) vertices.size() > m_max_vertices) {
-    throw std::runtime_error("vertex buffer out of memory");
+bool vertex_buffer_t::reserve(int page, int vertex_count, int index_count, int& vertex_offset, int& index_offset) {
+  if (!m_pages[page]) return false;
+  
+  vertex_offset = m_pages[page]->vertices.allocate(vertex_count);
+  if (vertex_offset < 0) return false;
+  
+  index_offset = m_pages[page]->indices.allocate(index_count);
+  if (index_offset < 0) {
+    m_pages[page]->vertices.free(vertex_offset, vertex_count);
+    return false;
   }
   
-  bind();
+  return true;
+}
+
+// GLES 3.0 has no base vertex draws, so indices are rebased on upload
+void vertex_buffer_t::upload_indices(const allocation_t& allocation) {
+  m_rebased.resize(allocation.indices.size());
   
-  int offset = m_offset;
-  m_offset += (int) vertices.size();
+  for (unsigned int i = 0; i < allocation.indices.size(); i++) {
+    m_rebased[i] = (unsigned short) (allocation.indices[i] + allocation.vertex_offset);
+  }
   
+  vertex_array_bind(m_pages[allocation.page]->vao);
+  glBufferSubData(
+    GL_ELEMENT_ARRAY_BUFFER,
+    allocation.index_offset * sizeof(unsigned short),
+    (int) m_rebased.size() * sizeof(unsigned short),
+    m_rebased.data()
+  );
+}
+
+mesh_t vertex_buffer_t::push(const mesh_view_t& mesh_view) {
+  int vertex_count = mesh_view.vertex_count;
+  int index_count = mesh_view.index_count;
+  
+  if (vertex_count > MAX_PAGE_VERTICES) {
+    throw std::runtime_error("mesh too large for 16-bit indices");
+  }
+  
+  // freed slots are reused first so their index and lod storage is too
+  int id;
+  
+  if (!m_free_allocations.empty()) {
+    id = m_free_allocations.back();
+    m_free_allocations.pop_back();
+  } else {
+    id = (int) m_allocations.size();
+    m_allocations.emplace_back();
+  }
+  
+  allocation_t& allocation = m_allocations[id];
+  allocation.page = -1;
+  
+  for (int page = 0; page < (int) m_pages.size(); page++) {
+    if (reserve(page, vertex_count, index_count, allocation.vertex_offset, allocation.index_offset)) {
+      allocation.page = page;
+      break;
+    }
+  }
+  
+  if (allocation.page < 0) {
+    int page = 0;
+    while (page < (int) m_pages.size() && m_pages[page]) page++;
+    if (page == (int) m_pages.size()) m_pages.emplace_back();
+    
+    m_pages[page] = std::make_unique<vertex_page_t>(
+      std::min(MAX_PAGE_VERTICES, std::max(m_page_vertices, vertex_count)),
+      std::max(m_page_indices, index_count)
+    );
+    
+    reserve(page, vertex_count, index_count, allocation.vertex_offset, allocation.index_offset);
+    allocation.page = page;
+  }
+  
+  allocation.vertex_count = vertex_count;
+  allocation.index_count = index_count;
+  allocation.indices.assign(mesh_view.indices, mesh_view.indices + index_count);
+  allocation.lods.assign(mesh_view.lods, mesh_view.lods + mesh_view.lod_count);
+  allocation.live = true;
+  
+  if (allocation.lods.empty()) {
+    allocation.lods.push_back({ 0, index_count, 0.0f });
+  }
+  
+  vertex_page_t& page = *m_pages[allocation.page];
+  page.num_allocations++;
+  
+  glBindBuffer(GL_ARRAY_BUFFER, page.vbo);
   glBufferSubData(
     GL_ARRAY_BUFFER,
-    offset * sizeof(vertex_t),
-    (int) vertices.size() * sizeof(vertex_t),
-    vertices.data()
+    allocation.vertex_offset * sizeof(packed_vertex_t),
+    vertex_count * sizeof(packed_vertex_t),
+    mesh_view.vertices
+  );
+  
+  upload_indices(allocation);
+  
+  return mesh_t(this, id, mesh_view);
+}
+
+void vertex_buffer_t::free(mesh_t mesh) {
+  int id = mesh.get_allocation();
+  if (id < 0 || id >= (int) m_allocations.size() || !m_allocations[id].live) return;
+  
+  allocation_t& allocation = m_allocations[id];
+  vertex_page_t& page = *m_pages[allocation.page];
+  
+  page.vertices.free(allocation.vertex_offset, allocation.vertex_count);
+  page.indices.free(allocation.index_offset, allocation.index_count);
+  page.num_allocations--;
+  
+  // page 0 is kept so there is always something to bind
+  if (page.num_allocations == 0 && allocation.page > 0) {
+    m_pages[allocation.page].reset();
+  }
+  
+  allocation.live = false;
+  allocation.indices.clear();
+  allocation.lods.clear();
+  m_free_allocations.push_back(id);
+}
+
+void vertex_buffer_t::draw(int id, int lod) {
+  const allocation_t& allocation = m_allocations[id];
+  if (!allocation.live) return;
+  
+  const mesh_lod_t& range = allocation.lods[std::min(lod, (int) allocation.lods.size() - 1)];
+  
+  vertex_array_bind(m_pages[allocation.page]->vao);
+  glDrawElements(
+    GL_TRIANGLES,
+    range.index_count,
+    GL_UNSIGNED_SHORT,
+    (void*) ((allocation.index_offset + range.index_offset) * sizeof(unsigned short))
   );
+}
+
+// Moves an allocation into an earlier page, or lower within its own page.
+bool vertex_buffer_t::move(int id) {
+  allocation_t& allocation = m_allocations[id];
+  
+  int target = -1;
+  int vertex_offset = -1;
+  int index_offset = -1;
+  
+  for (int page = 0; page < allocation.page && target < 0; page++) {
+    if (reserve(page, allocation.vertex_count, allocation.index_count, vertex_offset, index_offset)) {
+      target = page;
+    }
+  }
+  
+  if (target < 0) {
+    vertex_page_t& page = *m_pages[allocation.page];
+    vertex_offset = page.vertices.allocate_below(allocation.vertex_count, allocation.vertex_offset);
+    index_offset = page.indices.allocate_below(allocation.index_count, allocation.index_offset);
+    
+    if (vertex_offset < 0 && index_offset < 0) return false;
+    
+    if (vertex_offset < 0) vertex_offset = allocation.vertex_offset;
+    else page.vertices.free(allocation.vertex_offset, allocation.vertex_count);
+    
+    if (index_offset < 0) index_offset = allocation.index_offset;
+    else page.indices.free(allocation.index_offset, allocation.index_count);
+    
+    target = allocation.page;
+  }
+  
+  vertex_page_t& src = *m_pages[allocation.page];
+  vertex_page_t& dst = *m_pages[target];
+  
+  if (&src != &dst || vertex_offset != allocation.vertex_offset) {
+    glBindBuffer(GL_COPY_READ_BUFFER, src.vbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dst.vbo);
+    glCopyBufferSubData(
+      GL_COPY_READ_BUFFER,
+      GL_COPY_WRITE_BUFFER,
+      allocation.vertex_offset * sizeof(packed_vertex_t),
+      vertex_offset * sizeof(packed_vertex_t),
+      allocation.vertex_count * sizeof(packed_vertex_t)
+    );
+  }
+  
+  if (&src != &dst) {
+    src.vertices.free(allocation.vertex_offset, allocation.vertex_count);
+    src.indices.free(allocation.index_offset, allocation.index_count);
+    src.num_allocations--;
+    dst.num_allocations++;
+    
+    if (src.num_allocations == 0 && allocation.page > 0) {
+      m_pages[allocation.page].reset();
+    }
+  }
+  
+  allocation.page = target;
+  allocation.vertex_offset = vertex_offset;
+  allocation.index_offset = index_offset;
+  upload_indices(allocation);
   
-  return mesh_t(offset, (int) vertices.size());
+  return true;
+}
+
+int vertex_buffer_t::compact(int max_moves) {
+  int moves = 0;
+  
+  for (int id = 0; id < (int) m_allocations.size() && moves < max_moves; id++) {
+    if (m_allocations[id].live && move(id)) {
+      moves++;
+    }
+  }
+  
+  return moves;
 }
 
 vertex_buffer_t::~vertex_buffer_t() {
-  glDeleteVertexArrays(1, &m_vao);
-  glDeleteBuffers(1, &m_vbo);
+  
 }
 
-mesh_t::mesh_t(int offset, int count) {
-  m_offset = offset;
-  m_count = count;
+mesh_t::mesh_t(vertex_buffer_t* vertex_buffer, int allocation, const mesh_view_t& mesh_view) {
+  m_vertex_buffer = vertex_buffer;
+  m_allocation = allocation;
+  m_decode_offset = mesh_view.bounds_min;
+  m_decode_scale = mesh_view.bounds_scale;
+  m_num_lods = std::max(1, std::min(MAX_MESH_LODS, mesh_view.lod_count));
+  
+  for (int lod = 0; lod < MAX_MESH_LODS; lod++) {
+    m_lod_error[lod] = lod < mesh_view.lod_count ? mesh_view.lods[lod].error : 0.0f;
+  }
 }
 
-mesh_t::mesh_t() : mesh_t(0, 0) {
+mesh_t::mesh_t() : mesh_t(nullptr, -1, mesh_view_t()) {
   
 }
 
-void mesh_t::draw() {
-  glDrawArrays(GL_TRIANGLES, m_offset, m_count);
+int mesh_t::get_allocation() const {
+  return m_allocation;
+}
+
+mat4 mesh_t::get_decode() const {
+  return mat4::scale(m_decode_scale) * mat4::translate(m_decode_offset);
+}
+
+vec3 mesh_t::get_center() const {
+  return m_decode_offset + vec3(m_decode_scale.x, m_decode_scale.y, m_decode_scale.z) * 0.5f;
+}
+
+float mesh_t::get_radius() const {
+  return (m_decode_scale * 0.5f).length();
+}
+
+int mesh_t::get_lod_count() const {
+  return m_num_lods;
+}
+
+float mesh_t::get_lod_error(int lod) const {
+  return m_lod_error[lod];
+}
+
+void mesh_t::draw(int lod) {
+  if (m_vertex_buffer) {
+    m_vertex_buffer->draw(m_allocation, lod);
+  }
 }
@@ -2,31 +2,83 @@
 #define VERTEX_BUFFER_H
 
 #include <glad/glad.h>
+#include <memory>
 #include <vector>
+#include <util/range_allocator.hpp>
 #include "vertex.hpp"
 
+class vertex_buffer_t;
+
 class mesh_t {
 private:
-  int m_offset;
-  int m_count;
+  vertex_buffer_t* m_vertex_buffer;
+  int m_allocation;
+  vec3 m_decode_offset;
+  vec3 m_decode_scale;
+  int m_num_lods;
+  float m_lod_error[MAX_MESH_LODS];
 public:
   mesh_t();
-  mesh_t(int offset, int count);
-  void draw();
+  mesh_t(vertex_buffer_t* vertex_buffer, int allocation, const mesh_view_t& mesh_view);
+  int get_allocation() const;
+  mat4 get_decode() const;
+  vec3 get_center() const;
+  float get_radius() const;
+  int get_lod_count() const;
+  float get_lod_error(int lod) const;
+  void draw(int lod = 0);
+};
+
+// One VAO with its own vertex and index buffer. Pages are capped at 65536
+// vertices so every draw can use 16-bit indices.
+class vertex_page_t {
+public:
+  GLuint vao;
+  GLuint vbo;
+  GLuint ibo;
+  range_allocator_t vertices;
+  range_allocator_t indices;
+  int num_allocations;
+  
+  vertex_page_t(int max_vertices, int max_indices);
+  ~vertex_page_t();
 };
 
+// Geometry heap: meshes are sub-allocated from pages, new pages are added
+// when none has room, and compact() slides live meshes down a few at a time
+// so emptied pages can be released.
 class vertex_buffer_t {
 private:
-  GLuint m_vao;
-  GLuint m_vbo;
-  int m_offset;
-  int m_max_vertices;
+  struct allocation_t {
+    int page;
+    int vertex_offset;
+    int vertex_count;
+    int index_offset;
+    int index_count;
+    std::vector<unsigned short> indices;
+    std::vector<mesh_lod_t> lods;
+    bool live;
+  };
+  
+  std::vector<std::unique_ptr<vertex_page_t>> m_pages;
+  std::vector<allocation_t> m_allocations;
+  std::vector<int> m_free_allocations;
+  std::vector<unsigned short> m_rebased;
+  int m_page_vertices;
+  int m_page_indices;
+  
+  bool reserve(int page, int vertex_count, int index_count, int& vertex_offset, int& index_offset);
+  void upload_indices(const allocation_t& allocation);
+  bool move(int id);
 
 public:
-  vertex_buffer_t(int max_vertices);
+  vertex_buffer_t(int page_vertices, int page_indices);
   ~vertex_buffer_t();
   void bind();
-  mesh_t push(std::vector<vertex_t> vertices);
+  mesh_t push(const mesh_view_t& mesh_view);
+  void free(mesh_t mesh);
+  void draw(int allocation, int lod);
+  int compact(int max_moves);
 };
 
 #endif
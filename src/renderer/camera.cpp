@@ -1,4 +1,5 @@
 #include "camera.hpp"
+#include "render_config.hpp"
 #include <iostream>
 
 struct ubo_camera {
@@ -6,32 +7,58 @@ struct ubo_camera {
   mat4 view_project;
   mat4 view;
   mat4 model;
+  mat4 decode;
   vec3 view_pos;
 };
 
+static const float FOV = M_PI / 2.0;
+
 camera_t::camera_t() : m_uniform_buffer(0, "ubo_camera", 512) {
-  m_project = mat4::perspective(1.0, M_PI / 2.0, 0.1, 100.0);
+  m_project = mat4::perspective(1.0, FOV, Z_NEAR, Z_FAR);
+  m_focal_length = 1.0 / tan(FOV / 2.0);
   m_view = mat4::identity();
 }
 
-void camera_t::sub(mat4 model) {
+static ubo_camera camera_data(mat4 model, mat4 decode, mat4 view, mat4 project, vec3 view_pos) {
   struct ubo_camera data;
-  data.MVP = model * m_view * m_project;
-  data.view_project = m_view * m_project;
-  data.view = m_view;
+  data.MVP = model * view * project;
+  data.decode = decode;
+  data.view_project = view * project;
+  data.view = view;
   data.model = model;
-  data.view_pos = m_view_pos;
+  data.view_pos = view_pos;
+  return data;
+}
+
+void camera_t::sub(mat4 model, mat4 decode) {
+  struct ubo_camera data = camera_data(model, decode, m_view, m_project, m_view_pos);
   m_uniform_buffer.sub(&data, 0, sizeof(data));
 }
 
-void camera_t::move(vec3 position, vec3 rotation) {
-  mat4 rx = mat4::rotate_x(-rotation.x);
-  mat4 ry = mat4::rotate_y(-rotation.y);
-  mat4 rz = mat4::rotate_z(-rotation.z);
-  mat4 translate = mat4::translate(-position);
-  
+void camera_t::sub(command_buffer_t& command_buffer, mat4 model, mat4 decode) {
+  struct ubo_camera data = camera_data(model, decode, m_view, m_project, m_view_pos);
+  command_buffer.sub(m_uniform_buffer, &data, 0, sizeof(data));
+}
+
+void camera_t::move(vec3 position, quat rotation) {
   m_view_pos = position;
-  m_view = translate * rz * ry * rx;
+  m_view = mat4::translate(-position) * mat4::rotate(rotation.conjugate());
+}
+
+mat4 camera_t::get_view() const {
+  return m_view;
+}
+
+mat4 camera_t::get_project() const {
+  return m_project;
+}
+
+vec3 camera_t::get_view_pos() const {
+  return m_view_pos;
+}
+
+float camera_t::get_focal_length() const {
+  return m_focal_length;
 }
 
 void camera_t::attach_shader(const shader_t& shader) {
@@ -4,6 +4,7 @@
 #include "shader_attachment.hpp"
 #include <util/math3d.hpp>
 #include <opengl/uniform_buffer.hpp>
+#include <opengl/command_buffer.hpp>
 #include <opengl/shader.hpp>
 
 class camera_t : public shader_attachment_t {
@@ -11,12 +12,18 @@ private:
   mat4 m_project;
   mat4 m_view;
   vec3 m_view_pos;
+  float m_focal_length;
   uniform_buffer_t m_uniform_buffer;
 
 public:
   camera_t();
-  void move(vec3 position, vec3 rotation);
-  void sub(mat4 model);
+  void move(vec3 position, quat rotation);
+  void sub(mat4 model, mat4 decode);
+  void sub(command_buffer_t& command_buffer, mat4 model, mat4 decode);
+  mat4 get_view() const;
+  mat4 get_project() const;
+  vec3 get_view_pos() const;
+  float get_focal_length() const;
   
   void attach_shader(const shader_t& shader) override;
 };
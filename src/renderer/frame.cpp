@@ -0,0 +1,54 @@
+#include "frame.hpp"
+#include "render_config.hpp"
+
+struct ubo_frame {
+  mat4 view;
+  mat4 project;
+  mat4 inv_view;
+  mat4 inv_project;
+  mat4 prev_view_project;
+  vec2 resolution;
+  float z_near;
+  float z_far;
+  float z_scale;
+  float z_offset;
+  float time;
+};
+
+static_assert(sizeof(ubo_frame) == 352, "ubo_frame must match the std140 layout in frame.glsl");
+
+frame_t::frame_t() : m_uniform_buffer(2, "ubo_frame", sizeof(ubo_frame)), m_time(0.0), m_first(true) {}
+
+void frame_t::update(const camera_t& camera, int width, int height, float time_step) {
+  m_time += time_step;
+  
+  mat4 view = camera.get_view();
+  mat4 project = camera.get_project();
+  mat4 view_project = view * project;
+  
+  if (m_first) {
+    m_prev_view_project = view_project;
+    m_first = false;
+  }
+  
+  struct ubo_frame data;
+  data.view = view;
+  data.project = project;
+  data.inv_view = view.inverse_affine();
+  data.inv_project = project.inverse();
+  data.prev_view_project = m_prev_view_project;
+  data.resolution = vec2(width, height);
+  data.z_near = Z_NEAR;
+  data.z_far = Z_FAR;
+  // mat4::perspective's depth mapping inverted: view z = z_offset / (ndc z - z_scale)
+  data.z_scale = (-Z_FAR + -Z_NEAR) / (-Z_FAR - -Z_NEAR);
+  data.z_offset = (2 * -Z_FAR * -Z_NEAR) / (-Z_FAR - -Z_NEAR);
+  data.time = m_time;
+  m_uniform_buffer.sub(&data, 0, sizeof(data));
+  
+  m_prev_view_project = view_project;
+}
+
+void frame_t::attach_shader(const shader_t& shader) {
+  m_uniform_buffer.attach_shader(shader);
+}
@@ -0,0 +1,26 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "shader_attachment.hpp"
+#include "camera.hpp"
+#include <util/math3d.hpp>
+#include <opengl/uniform_buffer.hpp>
+#include <opengl/shader.hpp>
+
+// Per-frame globals for the post passes, filled once per frame so shaders
+// don't invert matrices or rebuild depth constants per pixel.
+class frame_t : public shader_attachment_t {
+private:
+  uniform_buffer_t m_uniform_buffer;
+  mat4 m_prev_view_project;
+  float m_time;
+  bool m_first;
+
+public:
+  frame_t();
+  void update(const camera_t& camera, int width, int height, float time_step);
+  
+  void attach_shader(const shader_t& shader) override;
+};
+
+#endif
@@ -7,12 +7,12 @@ class material_t {
 public:
   texture_t& albedo;
   texture_t& normal;
-  texture_t& roughness;
+  texture_t& orm;
 
-  material_t(texture_t& _albedo, texture_t& _normal, texture_t& _roughness)
+  material_t(texture_t& _albedo, texture_t& _normal, texture_t& _orm)
     : albedo(_albedo),
       normal(_normal),
-      roughness(_roughness)
+      orm(_orm)
     {}
 };
 
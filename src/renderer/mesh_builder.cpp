@@ -1,89 +1,478 @@
 #include "mesh_builder.hpp"
+#include "mesh_simplifier.hpp"
+#include <util/hash.hpp>
+#include <util/thread_pool.hpp>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+// small meshes are cheaper to solve inline than to hand to the pool
+static const int PARALLEL_MIN_TRIANGLES = 4096;
+
+// every vertex of a part must be reachable with a 16-bit index
+static const unsigned int MAX_PART_VERTICES = 65536;
+
+static int parallel_chunks(int num_triangles) {
+  return num_triangles < PARALLEL_MIN_TRIANGLES ? 1 : thread_pool_t::shared().size() + 1;
+}
+
+void mesh_builder_t::reset() {
+  m_vertices.clear();
+}
+
+void mesh_builder_t::set_max_lods(int max_lods) {
+  m_max_lods = std::max(1, std::min(MAX_MESH_LODS, max_lods));
+}
 
 void mesh_builder_t::push_vertex(vertex_t vertex) {
   m_vertices.push_back(vertex);
 }
 
-void mesh_builder_t::push_quad(mat4 T_p, mat4 T_uv) {
-  vec3 quad_p[] = {
-    vec3(+1, +1, 0),
-    vec3(-1, +1, 0),
-    vec3(-1, -1, 0),
-    vec3(+1, -1, 0),
-    vec3(+1, +1, 0),
-    vec3(-1, -1, 0)
-  };
+// Grows the triangle list by count vertices and returns them for filling in.
+// Disjoint parts of the range can be written from different threads.
+vertex_t* mesh_builder_t::push_vertices(int count) {
+  size_t offset = m_vertices.size();
+  m_vertices.resize(offset + count);
+  return m_vertices.data() + offset;
+}
+
+void mesh_builder_t::push_quad(const mat4& T_p, const mat4& T_uv) {
+  push_quads(&T_p, 1, T_uv);
+}
+
+// The unit quad spans -1..1 on x and y, so each corner is the transformed
+// origin plus or minus the first two transformed axes, and the normal is
+// their cross product: three products per quad instead of one per vertex.
+// Quads face the way their corners wind, so T must not mirror them.
+void mesh_builder_t::push_quads(const mat4* T_p, int count, const mat4& T_uv) {
+  vec2 uv_o = (T_uv * vec4(0, 0, 0, 1)).get_xy();
+  vec2 uv_x = (T_uv * vec4(1, 0, 0, 0)).get_xy();
+  vec2 uv_y = (T_uv * vec4(0, 1, 0, 0)).get_xy();
   
-  vec2 quad_uv[] = {
-    vec2(1, 1),
-    vec2(0, 1),
-    vec2(0, 0),
-    vec2(1, 0),
-    vec2(1, 1),
-    vec2(0, 0)
-  };
+  vec2 uv[4] = { uv_o + uv_x + uv_y, uv_o + uv_y, uv_o, uv_o + uv_x };
   
-  vec3 v_n = (T_p * vec4(0, 0, 1, 1) - T_p * vec4()).get_xyz().normalize();
+  vertex_t* out = push_vertices(count * 6);
   
-  for (int i = 0; i < 6; i++) {
-    vec3 v_p = (T_p * vec4(quad_p[i], 1)).get_xyz();
-    vec2 v_uv = (T_uv * vec4(quad_uv[i], 0, 1)).get_xy();
-    push_vertex(vertex_t(v_p, v_n, v_uv));
+  for (int i = 0; i < count; i++) {
+    const mat4& T = T_p[i];
+    
+    vec3 o = (T * vec4(0, 0, 0, 1)).get_xyz();
+    vec3 x = (T * vec4(1, 0, 0, 0)).get_xyz();
+    vec3 y = (T * vec4(0, 1, 0, 0)).get_xyz();
+    vec3 n = vec3::cross(x, y).normalize();
+    
+    vertex_t corners[4] = {
+      vertex_t(o + x + y, n, uv[0]),
+      vertex_t(o - x + y, n, uv[1]),
+      vertex_t(o - x - y, n, uv[2]),
+      vertex_t(o + x - y, n, uv[3])
+    };
+    
+    out[0] = corners[0];
+    out[1] = corners[1];
+    out[2] = corners[2];
+    out[3] = corners[3];
+    out[4] = corners[0];
+    out[5] = corners[2];
+    out += 6;
   }
 }
 
+static constexpr vec3 CUBOID_H = vec3(1, 0, 0);
+static constexpr vec3 CUBOID_V = vec3(0, 1, 0);
+static constexpr vec3 CUBOID_F = vec3(0, 0, 1);
+
+// the unit quad pushed out onto each face of the [-1, 1] cube, each basis
+// right-handed so the quad winds towards the outside
+static constexpr mat4 CUBOID_FACES[6] = {
+  mat4::translate(CUBOID_F) * mat4(+CUBOID_H, +CUBOID_V, +CUBOID_F),
+  mat4::translate(CUBOID_F) * mat4(-CUBOID_H, +CUBOID_V, -CUBOID_F),
+  mat4::translate(CUBOID_F) * mat4(-CUBOID_F, +CUBOID_V, +CUBOID_H),
+  mat4::translate(CUBOID_F) * mat4(+CUBOID_F, +CUBOID_V, -CUBOID_H),
+  mat4::translate(CUBOID_F) * mat4(-CUBOID_H, +CUBOID_F, +CUBOID_V),
+  mat4::translate(CUBOID_F) * mat4(+CUBOID_H, +CUBOID_F, -CUBOID_V)
+};
+
 void mesh_builder_t::push_cuboid(vec3 a, vec3 b) {
-  vec3 h = vec3(1, 0, 0);
-  vec3 v = vec3(0, 1, 0);
-  vec3 f = vec3(0, 0, 1);
-  
-  mat4 F = mat4(+h, +v, +f);
-  mat4 B = mat4(+h, +v, -f);
-  mat4 R = mat4(+f, +v, +h);
-  mat4 L = mat4(+f, +v, -h);
-  mat4 U = mat4(+h, +f, +v);
-  mat4 D = mat4(+h, +f, -v);
-  
-  mat4 p = mat4::translate(f);
   mat4 q = mat4::scale(b - a) * mat4::translate(b) * mat4::scale(vec3(0.5));
   
-  this->push_quad(p * F * q, mat4::identity());
-  this->push_quad(p * B * q, mat4::identity());
-  this->push_quad(p * R * q, mat4::identity());
-  this->push_quad(p * L * q, mat4::identity());
-  this->push_quad(p * U * q, mat4::identity());
-  this->push_quad(p * D * q, mat4::identity());
+  mat4 faces[6];
+  
+  for (int i = 0; i < 6; i++) {
+    faces[i] = CUBOID_FACES[i] * q;
+  }
+  
+  this->push_quads(faces, 6, mat4::identity());
+}
+
+// Per-triangle tangent direction and uv handedness, as MikkTSpace derives
+// them: only the direction of the tangent is kept, and a zero-area uv
+// triangle contributes nothing.
+void mesh_builder_t::solve_frames() {
+  int num_triangles = (int) m_vertices.size() / 3;
+  m_frames.resize(num_triangles);
+  
+  thread_pool_t::shared().parallel_for(num_triangles, parallel_chunks(num_triangles), [this](int chunk, int begin, int end) {
+    for (int triangle = begin; triangle < end; triangle++) {
+      const vertex_t& v1 = m_vertices[triangle * 3 + 0];
+      const vertex_t& v2 = m_vertices[triangle * 3 + 1];
+      const vertex_t& v3 = m_vertices[triangle * 3 + 2];
+      
+      vec3 d_pos1 = v2.pos - v1.pos;
+      vec3 d_pos2 = v3.pos - v1.pos;
+      
+      vec2 d_uv1 = v2.uv - v1.uv;
+      vec2 d_uv2 = v3.uv - v1.uv;
+      
+      float area = d_uv1.x * d_uv2.y - d_uv2.x * d_uv1.y;
+      float orientation = area < 0.0f ? -1.0f : 1.0f;
+      
+      vec3 tangent = (d_pos1 * d_uv2.y - d_pos2 * d_uv1.y) * orientation;
+      float length = tangent.length();
+      
+      if (area == 0.0f || !(length > 0.0f)) {
+        m_frames[triangle] = vec4(0, 0, 0, 1);
+      } else {
+        m_frames[triangle] = vec4(tangent * (1.0f / length), orientation);
+      }
+    }
+  });
 }
 
+// Projects each corner's triangle tangent onto the corner normal, weights it
+// by the corner angle and sums the corners of each welded vertex. Corners are
+// gathered per vertex rather than scattered so vertex ranges run in parallel
+// without atomics.
 void mesh_builder_t::solve_tangents() {
-  for (unsigned int i = 0; i < m_vertices.size(); i += 3) {
-    vertex_t& v1 = m_vertices[i + 0];
-    vertex_t& v2 = m_vertices[i + 1];
-    vertex_t& v3 = m_vertices[i + 2];
+  int num_triangles = (int) m_indices.size() / 3;
+  int vertex_count = (int) m_unique.size();
+  
+  m_corners.resize(m_indices.size());
+  
+  thread_pool_t& pool = thread_pool_t::shared();
+  int num_chunks = parallel_chunks(num_triangles);
+  
+  pool.parallel_for(num_triangles, num_chunks, [this](int chunk, int begin, int end) {
+    for (int triangle = begin; triangle < end; triangle++) {
+      vec4 frame = m_frames[triangle];
+      vec3 tangent = frame.get_xyz();
+      
+      for (int k = 0; k < 3; k++) {
+        const vertex_t& vertex = m_unique[m_indices[triangle * 3 + k]];
+        vec3 p0 = vertex.pos;
+        vec3 p1 = m_unique[m_indices[triangle * 3 + (k + 1) % 3]].pos;
+        vec3 p2 = m_unique[m_indices[triangle * 3 + (k + 2) % 3]].pos;
+        vec3 n = vertex.normal;
+        
+        vec3 t = tangent - n * vec3::dot(n, tangent);
+        vec3 e1 = (p1 - p0) - n * vec3::dot(n, p1 - p0);
+        vec3 e2 = (p2 - p0) - n * vec3::dot(n, p2 - p0);
+        
+        float t_length = t.length();
+        float e_length = e1.length() * e2.length();
+        
+        if (t_length > 0.0f && e_length > 0.0f) {
+          float angle = acosf(std::max(-1.0f, std::min(1.0f, vec3::dot(e1, e2) / e_length)));
+          m_corners[triangle * 3 + k] = t * (angle / t_length);
+        } else {
+          m_corners[triangle * 3 + k] = vec3(0.0);
+        }
+      }
+    }
+  });
+  
+  m_adjacency.build(m_indices, vertex_count);
+  
+  pool.parallel_for(vertex_count, num_chunks, [this](int chunk, int begin, int end) {
+    const triangle_adjacency_t& adjacency = m_adjacency;
+    
+    for (int v = begin; v < end; v++) {
+      vec3 sum = vec3(0.0);
+      
+      for (int i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; i++) {
+        int triangle = adjacency.triangles[i];
+        
+        for (int k = 0; k < 3; k++) {
+          if (m_indices[triangle * 3 + k] == v) {
+            sum += m_corners[triangle * 3 + k];
+          }
+        }
+      }
+      
+      vertex_t& vertex = m_unique[v];
+      vec3 n = vertex.normal;
+      vec3 t = sum - n * vec3::dot(n, sum);
+      
+      // no usable uvs around this vertex, so any tangent in the plane will do
+      if (!(t.length_squared() > 1e-12f)) {
+        vec3 axis = fabsf(n.x) < 0.9f ? vec3(1, 0, 0) : vec3(0, 1, 0);
+        t = axis - n * vec3::dot(n, axis);
+      }
+      
+      vertex.tangent = t.normalize();
+      vertex.bitangent = vec3::cross(n, vertex.tangent) * m_frames[adjacency.triangles[adjacency.offsets[v]]].w;
+    }
+  });
+}
+
+mesh_builder_t::weld_key_t mesh_builder_t::weld_key(unsigned int i) const {
+  const vertex_t& vertex = m_vertices[i];
+  weld_key_t key = { vertex.pos, vertex.normal, vertex.uv, m_frames[i / 3].w };
+  
+  // adding zero turns -0 into +0 so both hash and compare the same
+  float* components = (float*) &key;
+  for (unsigned int j = 0; j < sizeof(weld_key_t) / sizeof(float); j++) {
+    components[j] += 0.0f;
+  }
+  
+  return key;
+}
+
+// The slot holding key in the weld table, or the empty slot it would go in.
+unsigned int mesh_builder_t::weld_slot(const weld_key_t& key) const {
+  unsigned int mask = (unsigned int) m_weld_table.size() - 1;
+  unsigned int slot = hash_bytes(&key, sizeof(weld_key_t)) & mask;
+  
+  while (
+    m_weld_table[slot] >= 0 &&
+    memcmp(&m_weld_keys[m_weld_table[slot]], &key, sizeof(weld_key_t)) != 0
+  ) {
+    slot = (slot + 1) & mask;
+  }
+  
+  return slot;
+}
 
-    vec3 d_pos1 = v2.pos - v1.pos;
-    vec3 d_pos2 = v3.pos - v1.pos;
+// Finds the first triangle of each part. A part is closed early, when the
+// next triangle could add more vertices than 16-bit indices have left.
+void mesh_builder_t::split(std::vector<int>& starts) {
+  std::vector<int>& table = m_weld_table;
+  std::vector<weld_key_t>& keys = m_weld_keys;
+  
+  table.assign(MAX_PART_VERTICES * 4, -1);
+  keys.clear();
+  starts.assign(1, 0);
+  
+  int num_triangles = (int) m_vertices.size() / 3;
+  
+  for (int triangle = 0; triangle < num_triangles; triangle++) {
+    if (keys.size() + 3 > MAX_PART_VERTICES) {
+      table.assign(table.size(), -1);
+      keys.clear();
+      starts.push_back(triangle);
+    }
     
-    vec2 d_uv1 = v2.uv - v1.uv;
-    vec2 d_uv2 = v3.uv - v1.uv;
+    for (int k = 0; k < 3; k++) {
+      weld_key_t key = weld_key(triangle * 3 + k);
+      unsigned int slot = weld_slot(key);
+      
+      if (table[slot] < 0) {
+        table[slot] = (int) keys.size();
+        keys.push_back(key);
+      }
+    }
+  }
+}
+
+// Merges vertices that share a position, normal, uv and tangent handedness,
+// the same grouping MikkTSpace smooths tangents over.
+void mesh_builder_t::weld() {
+  unsigned int table_size = 16;
+  while (table_size < m_vertices.size() * 2) table_size *= 2;
+  
+  std::vector<int>& table = m_weld_table;
+  std::vector<weld_key_t>& keys = m_weld_keys;
+  
+  table.assign(table_size, -1);
+  keys.clear();
+  
+  m_unique.clear();
+  m_indices.clear();
+  m_indices.reserve(m_vertices.size());
+  
+  for (unsigned int i = 0; i < m_vertices.size(); i++) {
+    const vertex_t& vertex = m_vertices[i];
+    weld_key_t key = weld_key(i);
+    unsigned int slot = weld_slot(key);
     
-    float f = 1.0f / (d_uv1.x * d_uv2.y - d_uv2.x * d_uv1.y);
+    if (table[slot] < 0) {
+      if (m_unique.size() >= MAX_PART_VERTICES) {
+        throw std::runtime_error("mesh has too many vertices for 16-bit indices");
+      }
+      
+      table[slot] = (int) m_unique.size();
+      keys.push_back(key);
+      m_unique.push_back(vertex);
+    }
     
-    vec3 tangent = (d_pos1 * d_uv2.y - d_pos2 * d_uv1.y) * f;
-    vec3 bitangent = (d_pos2 * d_uv1.x - d_pos1 * d_uv2.x) * f;
+    m_indices.push_back((unsigned short) table[slot]);
+  }
+}
+
+// simplification stops once a collapse would move the surface further than
+// this fraction of the bounding box diagonal
+static const float LOD_MAX_ERROR = 0.05f;
+
+// Builds the LOD chain, reorders each level's triangles for the
+// post-transform cache and then by cluster for overdraw, and finally puts
+// vertices into first-use order for fetch locality.
+void mesh_builder_t::optimize() {
+  static const bool report = getenv("NUI_MESH_STATS") != nullptr;
+  
+  std::vector<vec3>& positions = m_positions;
+  positions.clear();
+  for (const vertex_t& vertex : m_unique) {
+    positions.push_back(vertex.pos);
+  }
+  
+  int vertex_count = (int) m_unique.size();
+  
+  vec3 bounds_min = positions.empty() ? vec3(0.0) : positions[0];
+  vec3 bounds_max = bounds_min;
+  
+  for (vec3 position : positions) {
+    bounds_min = vec3::min(bounds_min, position);
+    bounds_max = vec3::max(bounds_max, position);
+  }
+  
+  float max_error = LOD_MAX_ERROR * (bounds_max - bounds_min).length();
+  
+  float errors[MAX_MESH_LODS] = { 0.0f };
+  int num_lods = 1;
+  
+  m_lod_indices[0] = m_indices;
+  
+  for (int lod = 1; lod < m_max_lods; lod++) {
+    std::vector<unsigned short>& indices = m_lod_indices[lod];
+    indices = m_indices;
     
-    v1.tangent = tangent;
-    v2.tangent = tangent;
-    v3.tangent = tangent;
+    int target = ((int) m_indices.size() / 3 >> lod) * 3;
+    float error = simplify(indices, positions, target, max_error);
     
-    v1.bitangent = bitangent;
-    v2.bitangent = bitangent;
-    v3.bitangent = bitangent;
+    // locked seams or the error limit have stalled the simplifier
+    if (indices.size() * 10 > m_lod_indices[lod - 1].size() * 9) break;
+    
+    errors[lod] = std::max(error, errors[lod - 1]);
+    num_lods++;
+  }
+  
+  m_stats.num_triangles = (int) m_indices.size() / 3;
+  
+  if (report) {
+    m_stats.acmr_before = analyze_acmr(m_indices, vertex_count, VERTEX_CACHE_SIZE);
+    m_stats.overdraw_before = analyze_overdraw(m_indices, positions);
+  }
+  
+  m_indices.clear();
+  m_lods.clear();
+  
+  for (int lod = 0; lod < num_lods; lod++) {
+    std::vector<unsigned short>& indices = m_lod_indices[lod];
+    
+    optimize_vertex_cache(indices, vertex_count, VERTEX_CACHE_SIZE, m_clusters);
+    optimize_overdraw(indices, m_clusters, positions);
+    
+    m_lods.push_back({ (int) m_indices.size(), (int) indices.size(), errors[lod] });
+    m_indices.insert(m_indices.end(), indices.begin(), indices.end());
+  }
+  
+  if (report) {
+    m_stats.acmr_after = analyze_acmr(m_lod_indices[0], vertex_count, VERTEX_CACHE_SIZE);
+    m_stats.overdraw_after = analyze_overdraw(m_lod_indices[0], positions);
+    std::cout << "mesh: " << m_stats << std::endl;
+    
+    for (unsigned int lod = 1; lod < m_lods.size(); lod++) {
+      std::cout << "mesh: lod " << lod << ": " << m_lods[lod].index_count / 3 << " triangles, error " << m_lods[lod].error << std::endl;
+    }
+  } else {
+    m_stats.acmr_before = m_stats.acmr_after = 0.0f;
+    m_stats.overdraw_before = m_stats.overdraw_after = 0.0f;
+  }
+  
+  // lod 0 comes first, so its vertices end up first in fetch order
+  optimize_vertex_fetch(m_indices, vertex_count, m_order);
+  m_reordered.clear();
+  
+  for (int old_index : m_order) {
+    m_reordered.push_back(m_unique[old_index]);
+  }
+  
+  m_unique.swap(m_reordered);
+}
+
+// Packs vertices relative to the mesh bounds into the caller's storage.
+void mesh_builder_t::pack(mesh_data_t& mesh_data) {
+  const std::vector<vertex_t>& unique = m_unique;
+  
+  mesh_data.indices.assign(m_indices.begin(), m_indices.end());
+  mesh_data.lods.assign(m_lods.begin(), m_lods.end());
+  
+  vec3 bounds_min = unique.empty() ? vec3(0.0) : unique[0].pos;
+  vec3 bounds_max = bounds_min;
+  
+  for (const vertex_t& vertex : unique) {
+    bounds_min = vec3::min(bounds_min, vertex.pos);
+    bounds_max = vec3::max(bounds_max, vertex.pos);
+  }
+  
+  // flat axes still need a non-zero scale to decode
+  vec3 extent = bounds_max - bounds_min;
+  mesh_data.bounds_min = bounds_min;
+  mesh_data.bounds_scale = vec3(
+    extent.x > 0.0f ? extent.x : 1.0f,
+    extent.y > 0.0f ? extent.y : 1.0f,
+    extent.z > 0.0f ? extent.z : 1.0f
+  );
+  
+  mesh_data.vertices.resize(unique.size());
+  
+  for (unsigned int i = 0; i < unique.size(); i++) {
+    mesh_data.vertices[i] = packed_vertex_t::pack(unique[i], mesh_data.bounds_min, mesh_data.bounds_scale);
   }
 }
 
-std::vector<vertex_t> mesh_builder_t::compile() {
+void mesh_builder_t::compile(mesh_data_t& mesh_data) {
+  solve_frames();
+  weld();
   solve_tangents();
-  return m_vertices;
+  optimize();
+  pack(mesh_data);
+}
+
+mesh_data_t mesh_builder_t::compile() {
+  mesh_data_t mesh_data;
+  compile(mesh_data);
+  return mesh_data;
+}
+
+void mesh_builder_t::compile_parts(std::vector<mesh_data_t>& parts) {
+  std::vector<int> starts;
+  solve_frames();
+  split(starts);
+  
+  parts.resize(starts.size());
+  
+  if (starts.size() == 1) {
+    weld();
+    solve_tangents();
+    optimize();
+    pack(parts[0]);
+    return;
+  }
+  
+  int num_triangles = (int) m_vertices.size() / 3;
+  mesh_builder_t part;
+  part.set_max_lods(m_max_lods);
+  
+  for (size_t i = 0; i < starts.size(); i++) {
+    int end = i + 1 < starts.size() ? starts[i + 1] : num_triangles;
+    
+    part.reset();
+    part.m_vertices.assign(m_vertices.begin() + starts[i] * 3, m_vertices.begin() + end * 3);
+    part.compile(parts[i]);
+  }
+}
+
+const mesh_stats_t& mesh_builder_t::get_stats() const {
+  return m_stats;
 }
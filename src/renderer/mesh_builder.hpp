@@ -2,18 +2,67 @@
 #define MESH_BUILDER_H
 
 #include <opengl/vertex.hpp>
+#include <renderer/mesh_optimizer.hpp>
 #include <vector>
 
+// Builders can be reset and reused: every buffer, including the scratch
+// space of each compile step, keeps its capacity. Once warmed up, a rebuild
+// of similar size with LODs disabled makes no heap allocations.
 class mesh_builder_t {
 private:
+  class weld_key_t {
+  public:
+    vec3 pos;
+    vec3 normal;
+    vec2 uv;
+    float handedness;
+  };
+  
   std::vector<vertex_t> m_vertices;
+  std::vector<vec4> m_frames;
+  std::vector<vertex_t> m_unique;
+  std::vector<unsigned short> m_indices;
+  std::vector<mesh_lod_t> m_lods;
+  int m_max_lods = MAX_MESH_LODS;
+  mesh_stats_t m_stats;
+  
+  std::vector<int> m_weld_table;
+  std::vector<weld_key_t> m_weld_keys;
+  std::vector<vec3> m_corners;
+  triangle_adjacency_t m_adjacency;
+  std::vector<vec3> m_positions;
+  std::vector<unsigned short> m_lod_indices[MAX_MESH_LODS];
+  std::vector<int> m_clusters;
+  std::vector<int> m_order;
+  std::vector<vertex_t> m_reordered;
+  
+  weld_key_t weld_key(unsigned int i) const;
+  unsigned int weld_slot(const weld_key_t& key) const;
+  
+  void solve_frames();
+  void split(std::vector<int>& starts);
+  void weld();
   void solve_tangents();
+  void optimize();
+  void pack(mesh_data_t& mesh_data);
 
 public:
+  void reset();
+  void set_max_lods(int max_lods);
+  
   void push_vertex(vertex_t vertex);
-  void push_quad(mat4 T_p, mat4 T_uv);
+  vertex_t* push_vertices(int count);
+  void push_quad(const mat4& T_p, const mat4& T_uv);
+  void push_quads(const mat4* T_p, int count, const mat4& T_uv);
   void push_cuboid(vec3 a, vec3 b);
-  std::vector<vertex_t> compile();
+  
+  void compile(mesh_data_t& mesh_data);
+  mesh_data_t compile();
+  
+  // Compiles meshes of any size. Triangles are taken in order, and a new
+  // part starts whenever the welded vertices would overflow 16-bit indices.
+  void compile_parts(std::vector<mesh_data_t>& parts);
+  const mesh_stats_t& get_stats() const;
 };
 
 #endif
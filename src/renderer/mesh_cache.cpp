@@ -0,0 +1,205 @@
+#include "mesh_cache.hpp"
+#include "mesh_importer.hpp"
+#include <util/hash.hpp>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+
+#define MESH_CACHE_DIR "cache/meshes"
+
+static const uint32_t MESH_CACHE_MAGIC = 0x4d49554e; // "NUIM"
+
+// One per part, each followed by its vertices and then its indices, so both
+// can be handed to the vertex buffer straight from the mapping. Parts start
+// 8-byte aligned.
+class mesh_cache_header_t {
+public:
+  uint32_t magic;
+  uint32_t version;
+  int64_t source_mtime;
+  uint64_t source_size;
+  int32_t vertex_count;
+  int32_t index_count;
+  int32_t lod_count;
+  float bounds_min[3];
+  float bounds_scale[3];
+  mesh_lod_t lods[MAX_MESH_LODS];
+};
+
+static_assert(sizeof(mesh_cache_header_t) % 4 == 0, "cached vertices must stay 4-byte aligned");
+
+static std::filesystem::path mesh_cache_path(const std::string& source_path) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.mesh", (unsigned long long) hash_string(source_path));
+  return std::filesystem::path(MESH_CACHE_DIR) / name;
+}
+
+static bool mesh_cache_source(const std::string& source_path, int64_t& mtime, uint64_t& size) {
+  std::error_code error;
+  std::filesystem::file_time_type time = std::filesystem::last_write_time(source_path, error);
+  if (error) return false;
+  
+  size = std::filesystem::file_size(source_path, error);
+  if (error) return false;
+  
+  mtime = time.time_since_epoch().count();
+  return true;
+}
+
+std::unique_ptr<mapped_file_t> mesh_cache_load(const std::string& source_path, std::vector<mesh_view_t>& mesh_views) {
+  std::filesystem::path path = mesh_cache_path(source_path);
+  
+  std::error_code error;
+  if (!std::filesystem::exists(path, error)) return nullptr;
+  
+  int64_t mtime;
+  uint64_t size;
+  if (!mesh_cache_source(source_path, mtime, size)) return nullptr;
+  
+  std::unique_ptr<mapped_file_t> file = std::make_unique<mapped_file_t>(path.string());
+  mesh_views.clear();
+  
+  size_t offset = 0;
+  
+  while (offset < file->size()) {
+    if (offset + sizeof(mesh_cache_header_t) > file->size()) return nullptr;
+    
+    mesh_cache_header_t header;
+    memcpy(&header, file->data() + offset, sizeof(header));
+    
+    if (
+      header.magic != MESH_CACHE_MAGIC ||
+      header.version != VERTEX_FORMAT_VERSION ||
+      header.source_mtime != mtime ||
+      header.source_size != size ||
+      header.vertex_count < 0 ||
+      header.index_count < 0 ||
+      header.lod_count < 0 ||
+      header.lod_count > MAX_MESH_LODS
+    ) {
+      return nullptr;
+    }
+    
+    size_t part_size =
+      sizeof(mesh_cache_header_t) +
+      (size_t) header.vertex_count * sizeof(packed_vertex_t) +
+      (size_t) header.index_count * sizeof(unsigned short);
+    
+    if (offset + part_size > file->size()) return nullptr;
+    
+    for (int lod = 0; lod < header.lod_count; lod++) {
+      const mesh_lod_t& range = header.lods[lod];
+      if (range.index_offset < 0 || range.index_count < 0 || range.index_offset + range.index_count > header.index_count) {
+        return nullptr;
+      }
+    }
+    
+    const char* data = file->data() + offset + sizeof(mesh_cache_header_t);
+    const mesh_cache_header_t* mapped_header = (const mesh_cache_header_t*) (file->data() + offset);
+    
+    mesh_view_t& mesh_view = mesh_views.emplace_back();
+    mesh_view.vertices = (const packed_vertex_t*) data;
+    mesh_view.vertex_count = header.vertex_count;
+    mesh_view.indices = (const unsigned short*) (data + header.vertex_count * sizeof(packed_vertex_t));
+    mesh_view.index_count = header.index_count;
+    mesh_view.lods = mapped_header->lods;
+    mesh_view.lod_count = header.lod_count;
+    mesh_view.bounds_min = vec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+    mesh_view.bounds_scale = vec3(header.bounds_scale[0], header.bounds_scale[1], header.bounds_scale[2]);
+    
+    offset += part_size;
+    if (offset < file->size()) offset = (offset + 7) & ~(size_t) 7;
+  }
+  
+  if (mesh_views.empty()) return nullptr;
+  
+  return file;
+}
+
+void mesh_cache_store(const std::string& source_path, const std::vector<mesh_data_t>& parts) {
+  int64_t source_mtime;
+  uint64_t source_size;
+  
+  if (!mesh_cache_source(source_path, source_mtime, source_size)) return;
+  
+  std::error_code error;
+  std::filesystem::create_directories(MESH_CACHE_DIR, error);
+  
+  std::filesystem::path path = mesh_cache_path(source_path);
+  std::filesystem::path tmp_path = path;
+  tmp_path += ".tmp";
+  
+  {
+    std::ofstream out(tmp_path, std::ios::binary);
+    if (!out) {
+      std::cerr << "warning: mesh_cache_store: could not write " << tmp_path << std::endl;
+      return;
+    }
+    
+    for (size_t part = 0; part < parts.size(); part++) {
+      const mesh_data_t& mesh_data = parts[part];
+      
+      mesh_cache_header_t header;
+      memset(&header, 0, sizeof(header));
+      
+      header.magic = MESH_CACHE_MAGIC;
+      header.version = VERTEX_FORMAT_VERSION;
+      header.source_mtime = source_mtime;
+      header.source_size = source_size;
+      header.vertex_count = (int32_t) mesh_data.vertices.size();
+      header.index_count = (int32_t) mesh_data.indices.size();
+      header.lod_count = (int32_t) std::min<size_t>(MAX_MESH_LODS, mesh_data.lods.size());
+      
+      header.bounds_min[0] = mesh_data.bounds_min.x;
+      header.bounds_min[1] = mesh_data.bounds_min.y;
+      header.bounds_min[2] = mesh_data.bounds_min.z;
+      header.bounds_scale[0] = mesh_data.bounds_scale.x;
+      header.bounds_scale[1] = mesh_data.bounds_scale.y;
+      header.bounds_scale[2] = mesh_data.bounds_scale.z;
+      
+      for (int lod = 0; lod < header.lod_count; lod++) {
+        header.lods[lod] = mesh_data.lods[lod];
+      }
+      
+      out.write((const char*) &header, sizeof(header));
+      out.write((const char*) mesh_data.vertices.data(), mesh_data.vertices.size() * sizeof(packed_vertex_t));
+      out.write((const char*) mesh_data.indices.data(), mesh_data.indices.size() * sizeof(unsigned short));
+      
+      if (part + 1 < parts.size()) {
+        static const char padding[8] = {};
+        std::streamoff end = out.tellp();
+        out.write(padding, -end & 7);
+      }
+    }
+  }
+  
+  std::filesystem::rename(tmp_path, path, error);
+}
+
+std::vector<mesh_t> mesh_cache_import(vertex_buffer_t& vertex_buffer, const std::string& source_path) {
+  std::vector<mesh_t> meshes;
+  std::vector<mesh_view_t> mesh_views;
+  std::unique_ptr<mapped_file_t> cached = mesh_cache_load(source_path, mesh_views);
+  
+  if (cached) {
+    for (const mesh_view_t& mesh_view : mesh_views) {
+      meshes.push_back(vertex_buffer.push(mesh_view));
+    }
+    
+    return meshes;
+  }
+  
+  mesh_builder_t mesh_builder;
+  import_mesh(mesh_builder, source_path);
+  
+  std::vector<mesh_data_t> parts;
+  mesh_builder.compile_parts(parts);
+  mesh_cache_store(source_path, parts);
+  
+  for (const mesh_data_t& mesh_data : parts) {
+    meshes.push_back(vertex_buffer.push(mesh_data));
+  }
+  
+  return meshes;
+}
@@ -0,0 +1,22 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <opengl/vertex.hpp>
+#include <opengl/vertex_buffer.hpp>
+#include <util/mapped_file.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Maps the cached build of source_path and points a view at each of its
+// parts. Returns null if there is no entry, or if the source or vertex format
+// has changed since it was written. The views are only valid while the
+// mapping is alive.
+std::unique_ptr<mapped_file_t> mesh_cache_load(const std::string& source_path, std::vector<mesh_view_t>& mesh_views);
+void mesh_cache_store(const std::string& source_path, const std::vector<mesh_data_t>& parts);
+
+// Pushes the parts of the cached build of an asset, importing and caching it
+// on a miss. Assets over 65536 vertices come back as several parts.
+std::vector<mesh_t> mesh_cache_import(vertex_buffer_t& vertex_buffer, const std::string& source_path);
+
+#endif
@@ -0,0 +1,600 @@
+#include "mesh_importer.hpp"
+#include <util/json.hpp>
+#include <util/mapped_file.hpp>
+#include <util/thread_pool.hpp>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+static bool ends_with(const std::string& str, const std::string& suffix) {
+  return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void import_mesh(mesh_builder_t& mesh_builder, const std::string& path) {
+  mapped_file_t file(path);
+  
+  if (ends_with(path, ".obj")) {
+    import_obj(mesh_builder, file.data(), file.size());
+  } else if (ends_with(path, ".gltf") || ends_with(path, ".glb")) {
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    import_gltf(mesh_builder, file.data(), file.size(), dir);
+  } else {
+    std::cerr << "error: import_mesh: unknown format " << path << std::endl;
+    throw std::runtime_error("unknown mesh format");
+  }
+}
+
+static vec3 face_normal(vec3 a, vec3 b, vec3 c) {
+  vec3 normal = vec3::cross(b - a, c - a);
+  float length = normal.length();
+  return length > 0.0f ? normal * (1.0f / length) : vec3(0, 0, 1);
+}
+
+// OBJ is parsed in three parallel passes over line-aligned chunks: count
+// elements per chunk, parse them at offsets from a prefix sum, then resolve
+// face corners straight into the builder's vertices.
+
+class obj_chunk_t {
+public:
+  const char* begin;
+  const char* end;
+  int positions;
+  int normals;
+  int uvs;
+  int triangles;
+};
+
+class obj_corner_t {
+public:
+  int position;
+  int uv;
+  int normal;
+};
+
+static const char* obj_skip_space(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+  return p;
+}
+
+static const char* obj_next_line(const char* p, const char* end) {
+  const char* newline = (const char*) memchr(p, '\n', end - p);
+  return newline ? newline + 1 : end;
+}
+
+static const char* obj_parse_float(const char* p, const char* end, float& value) {
+  p = obj_skip_space(p, end);
+  value = 0.0f;
+  std::from_chars_result result = std::from_chars(p, end, value);
+  return result.ptr;
+}
+
+static const char* obj_parse_int(const char* p, const char* end, int& value) {
+  std::from_chars_result result = std::from_chars(p, end, value);
+  return result.ptr;
+}
+
+// OBJ indices are one-based, negative ones count back from the latest element
+static int obj_resolve(int index, int base) {
+  if (index > 0) return index - 1;
+  if (index < 0) return base + index;
+  return -1;
+}
+
+static void obj_count(obj_chunk_t& chunk) {
+  chunk.positions = 0;
+  chunk.normals = 0;
+  chunk.uvs = 0;
+  chunk.triangles = 0;
+  
+  for (const char* line = chunk.begin; line < chunk.end; line = obj_next_line(line, chunk.end)) {
+    const char* p = obj_skip_space(line, chunk.end);
+    if (chunk.end - p < 2) continue;
+    
+    if (p[0] == 'v' && p[1] == ' ') chunk.positions++;
+    else if (p[0] == 'v' && p[1] == 'n') chunk.normals++;
+    else if (p[0] == 'v' && p[1] == 't') chunk.uvs++;
+    else if (p[0] == 'f' && p[1] == ' ') {
+      const char* line_end = obj_next_line(p, chunk.end);
+      int corners = 0;
+      p += 1;
+      
+      while (true) {
+        p = obj_skip_space(p, line_end);
+        if (p >= line_end || *p == '\n' || *p == '#') break;
+        corners++;
+        while (p < line_end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+      }
+      
+      if (corners >= 3) chunk.triangles += corners - 2;
+    }
+  }
+}
+
+static bool obj_parse(
+  const obj_chunk_t& chunk,
+  const obj_chunk_t& offsets,
+  std::vector<vec3>& positions,
+  std::vector<vec3>& normals,
+  std::vector<vec2>& uvs,
+  std::vector<obj_corner_t>& corners
+) {
+  int num_positions = offsets.positions;
+  int num_normals = offsets.normals;
+  int num_uvs = offsets.uvs;
+  int num_corners = offsets.triangles * 3;
+  
+  for (const char* line = chunk.begin; line < chunk.end; line = obj_next_line(line, chunk.end)) {
+    const char* line_end = obj_next_line(line, chunk.end);
+    const char* p = obj_skip_space(line, line_end);
+    if (line_end - p < 2) continue;
+    
+    if (p[0] == 'v' && p[1] == ' ') {
+      vec3& v = positions[num_positions++];
+      p = obj_parse_float(p + 1, line_end, v.x);
+      p = obj_parse_float(p, line_end, v.y);
+      p = obj_parse_float(p, line_end, v.z);
+    } else if (p[0] == 'v' && p[1] == 'n') {
+      vec3& v = normals[num_normals++];
+      p = obj_parse_float(p + 2, line_end, v.x);
+      p = obj_parse_float(p, line_end, v.y);
+      p = obj_parse_float(p, line_end, v.z);
+    } else if (p[0] == 'v' && p[1] == 't') {
+      vec2& v = uvs[num_uvs++];
+      p = obj_parse_float(p + 2, line_end, v.x);
+      p = obj_parse_float(p, line_end, v.y);
+    } else if (p[0] == 'f' && p[1] == ' ') {
+      obj_corner_t first, previous;
+      int count = 0;
+      p += 1;
+      
+      while (true) {
+        p = obj_skip_space(p, line_end);
+        if (p >= line_end || *p == '\n' || *p == '#') break;
+        
+        int position = 0, uv = 0, normal = 0;
+        p = obj_parse_int(p, line_end, position);
+        
+        if (p < line_end && *p == '/') {
+          p++;
+          if (p < line_end && *p != '/') p = obj_parse_int(p, line_end, uv);
+          if (p < line_end && *p == '/') p = obj_parse_int(p + 1, line_end, normal);
+        }
+        
+        while (p < line_end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+        
+        obj_corner_t corner = {
+          obj_resolve(position, num_positions),
+          obj_resolve(uv, num_uvs),
+          obj_resolve(normal, num_normals)
+        };
+        
+        if (corner.position < 0) return false;
+        
+        // faces are fanned around their first corner
+        if (count == 0) first = corner;
+        if (count >= 2) {
+          corners[num_corners++] = first;
+          corners[num_corners++] = previous;
+          corners[num_corners++] = corner;
+        }
+        
+        previous = corner;
+        count++;
+      }
+    }
+  }
+  
+  return true;
+}
+
+void import_obj(mesh_builder_t& mesh_builder, const char* data, size_t size) {
+  thread_pool_t& pool = thread_pool_t::shared();
+  
+  // several chunks per thread keeps the load even when lines vary in length
+  int num_chunks = (int) std::max<size_t>(1, std::min<size_t>((pool.size() + 1) * 4, size / 65536));
+  std::vector<obj_chunk_t> chunks(num_chunks);
+  
+  const char* end = data + size;
+  const char* begin = data;
+  
+  for (int i = 0; i < num_chunks; i++) {
+    const char* split = i + 1 < num_chunks ? std::max(begin, data + size * (i + 1) / num_chunks) : end;
+    split = split < end ? obj_next_line(split, end) : end;
+    chunks[i].begin = begin;
+    chunks[i].end = split;
+    begin = split;
+  }
+  
+  pool.parallel_for(num_chunks, num_chunks, [&chunks](int chunk, int begin, int end) {
+    obj_count(chunks[chunk]);
+  });
+  
+  std::vector<obj_chunk_t> offsets(num_chunks + 1);
+  offsets[0] = { nullptr, nullptr, 0, 0, 0, 0 };
+  
+  for (int i = 0; i < num_chunks; i++) {
+    offsets[i + 1].positions = offsets[i].positions + chunks[i].positions;
+    offsets[i + 1].normals = offsets[i].normals + chunks[i].normals;
+    offsets[i + 1].uvs = offsets[i].uvs + chunks[i].uvs;
+    offsets[i + 1].triangles = offsets[i].triangles + chunks[i].triangles;
+  }
+  
+  const obj_chunk_t& total = offsets[num_chunks];
+  
+  std::vector<vec3> positions(total.positions);
+  std::vector<vec3> normals(total.normals);
+  std::vector<vec2> uvs(total.uvs);
+  std::vector<obj_corner_t> corners(total.triangles * 3);
+  std::atomic<bool> valid(true);
+  
+  pool.parallel_for(num_chunks, num_chunks, [&](int chunk, int begin, int end) {
+    if (!obj_parse(chunks[chunk], offsets[chunk], positions, normals, uvs, corners)) {
+      valid = false;
+    }
+  });
+  
+  if (!valid) {
+    std::cerr << "error: import_obj: face without a position index" << std::endl;
+    throw std::runtime_error("invalid obj file");
+  }
+  
+  vertex_t* vertices = mesh_builder.push_vertices(total.triangles * 3);
+  
+  pool.parallel_for(total.triangles, num_chunks, [&](int chunk, int begin, int end) {
+    for (int triangle = begin; triangle < end; triangle++) {
+      const obj_corner_t* corner = &corners[triangle * 3];
+      
+      for (int k = 0; k < 3; k++) {
+        if (
+          corner[k].position >= total.positions ||
+          corner[k].uv >= total.uvs ||
+          corner[k].normal >= total.normals
+        ) {
+          valid = false;
+          return;
+        }
+      }
+      
+      vec3 p[3] = { positions[corner[0].position], positions[corner[1].position], positions[corner[2].position] };
+      vec3 flat = face_normal(p[0], p[1], p[2]);
+      
+      for (int k = 0; k < 3; k++) {
+        vec3 normal = corner[k].normal >= 0 ? normals[corner[k].normal] : flat;
+        // OBJ puts the uv origin at the bottom left, texture_t at the top left
+        vec2 uv = corner[k].uv >= 0 ? vec2(uvs[corner[k].uv].x, 1.0f - uvs[corner[k].uv].y) : vec2(0.0);
+        vertices[triangle * 3 + k] = vertex_t(p[k], normal, uv);
+      }
+    }
+  });
+  
+  if (!valid) {
+    std::cerr << "error: import_obj: index out of range" << std::endl;
+    throw std::runtime_error("invalid obj file");
+  }
+}
+
+// glTF buffers are either the GLB binary chunk, a base64 data URI or an
+// external file, which is mapped alongside the main one.
+
+static const uint32_t GLB_MAGIC = 0x46546c67;
+static const uint32_t GLB_CHUNK_JSON = 0x4e4f534a;
+static const uint32_t GLB_CHUNK_BIN = 0x004e4942;
+
+static const int GLTF_BYTE = 5120;
+static const int GLTF_UNSIGNED_BYTE = 5121;
+static const int GLTF_SHORT = 5122;
+static const int GLTF_UNSIGNED_SHORT = 5123;
+static const int GLTF_UNSIGNED_INT = 5125;
+static const int GLTF_FLOAT = 5126;
+static const int GLTF_TRIANGLES = 4;
+
+class gltf_buffer_t {
+public:
+  const char* data;
+  size_t size;
+};
+
+class gltf_accessor_t {
+public:
+  const char* data;
+  int count;
+  int stride;
+  int component_type;
+  int components;
+  bool normalized;
+  
+  float read(int index, int component) const {
+    const char* p = data + (size_t) index * stride;
+    
+    switch (component_type) {
+    case GLTF_FLOAT: {
+      float value;
+      memcpy(&value, p + component * 4, 4);
+      return value;
+    }
+    case GLTF_UNSIGNED_BYTE: {
+      uint8_t value = p[component];
+      return normalized ? value / 255.0f : value;
+    }
+    case GLTF_BYTE: {
+      int8_t value = p[component];
+      return normalized ? std::max(value / 127.0f, -1.0f) : value;
+    }
+    case GLTF_UNSIGNED_SHORT: {
+      uint16_t value;
+      memcpy(&value, p + component * 2, 2);
+      return normalized ? value / 65535.0f : value;
+    }
+    case GLTF_SHORT: {
+      int16_t value;
+      memcpy(&value, p + component * 2, 2);
+      return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+    }
+    default:
+      return 0.0f;
+    }
+  }
+  
+  uint32_t read_index(int index) const {
+    const char* p = data + (size_t) index * stride;
+    
+    switch (component_type) {
+    case GLTF_UNSIGNED_BYTE:
+      return (uint8_t) *p;
+    case GLTF_UNSIGNED_SHORT: {
+      uint16_t value;
+      memcpy(&value, p, 2);
+      return value;
+    }
+    case GLTF_UNSIGNED_INT: {
+      uint32_t value;
+      memcpy(&value, p, 4);
+      return value;
+    }
+    default:
+      return 0;
+    }
+  }
+};
+
+static int gltf_component_size(int component_type) {
+  switch (component_type) {
+  case GLTF_BYTE:
+  case GLTF_UNSIGNED_BYTE:
+    return 1;
+  case GLTF_SHORT:
+  case GLTF_UNSIGNED_SHORT:
+    return 2;
+  case GLTF_UNSIGNED_INT:
+  case GLTF_FLOAT:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+static int gltf_component_count(std::string_view type) {
+  if (type == "SCALAR") return 1;
+  if (type == "VEC2") return 2;
+  if (type == "VEC3") return 3;
+  if (type == "VEC4") return 4;
+  return 0;
+}
+
+static void gltf_fail(const char* message) {
+  std::cerr << "error: import_gltf: " << message << std::endl;
+  throw std::runtime_error("invalid gltf file");
+}
+
+static std::vector<char> base64_decode(std::string_view text) {
+  static const std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  
+  int table[256];
+  for (int i = 0; i < 256; i++) table[i] = -1;
+  for (int i = 0; i < 64; i++) table[(unsigned char) alphabet[i]] = i;
+  
+  std::vector<char> result;
+  result.reserve(text.size() / 4 * 3);
+  
+  uint32_t bits = 0;
+  int num_bits = 0;
+  
+  for (char c : text) {
+    int value = table[(unsigned char) c];
+    if (value < 0) continue;
+    
+    bits = (bits << 6) | value;
+    num_bits += 6;
+    
+    if (num_bits >= 8) {
+      num_bits -= 8;
+      result.push_back((char) ((bits >> num_bits) & 0xff));
+    }
+  }
+  
+  return result;
+}
+
+static gltf_accessor_t gltf_accessor(json_value_t root, int index, const std::vector<gltf_buffer_t>& buffers) {
+  json_value_t accessor = root.get("accessors").at(index);
+  if (!accessor.is_valid()) gltf_fail("accessor out of range");
+  if (accessor.get("sparse").is_valid()) gltf_fail("sparse accessors are not supported");
+  
+  gltf_accessor_t result;
+  result.count = accessor.get("count").as_int();
+  result.component_type = accessor.get("componentType").as_int();
+  result.components = gltf_component_count(accessor.get("type").as_string());
+  result.normalized = accessor.get("normalized").as_bool();
+  
+  int element_size = gltf_component_size(result.component_type) * result.components;
+  if (element_size == 0) gltf_fail("unsupported accessor type");
+  
+  // an accessor without a buffer view reads as zeros; every element shares
+  // one zeroed element
+  if (!accessor.get("bufferView").is_valid()) {
+    static const char zeros[16] = {};
+    result.data = zeros;
+    result.stride = 0;
+    return result;
+  }
+  
+  json_value_t view = root.get("bufferViews").at(accessor.get("bufferView").as_int(-1));
+  if (!view.is_valid()) gltf_fail("buffer view out of range");
+  
+  int buffer = view.get("buffer").as_int(-1);
+  if (buffer < 0 || buffer >= (int) buffers.size()) gltf_fail("buffer out of range");
+  
+  result.stride = view.get("byteStride").as_int(element_size);
+  
+  size_t view_offset = (size_t) view.get("byteOffset").as_number();
+  size_t view_length = (size_t) view.get("byteLength").as_number();
+  size_t offset = (size_t) accessor.get("byteOffset").as_number();
+  
+  if (view_offset + view_length > buffers[buffer].size) gltf_fail("buffer view out of range");
+  
+  if (result.count > 0 && offset + (size_t) (result.count - 1) * result.stride + element_size > view_length) {
+    gltf_fail("accessor out of range");
+  }
+  
+  result.data = buffers[buffer].data + view_offset + offset;
+  return result;
+}
+
+void import_gltf(mesh_builder_t& mesh_builder, const char* data, size_t size, const std::string& dir) {
+  const char* json_data = data;
+  size_t json_size = size;
+  gltf_buffer_t binary_chunk = { nullptr, 0 };
+  
+  uint32_t magic = 0;
+  if (size >= 4) memcpy(&magic, data, 4);
+  
+  if (magic == GLB_MAGIC) {
+    size_t offset = 12;
+    json_size = 0;
+    
+    while (offset + 8 <= size) {
+      uint32_t chunk_length, chunk_type;
+      memcpy(&chunk_length, data + offset, 4);
+      memcpy(&chunk_type, data + offset + 4, 4);
+      offset += 8;
+      
+      if (offset + chunk_length > size) gltf_fail("chunk out of range");
+      
+      if (chunk_type == GLB_CHUNK_JSON) {
+        json_data = data + offset;
+        json_size = chunk_length;
+      } else if (chunk_type == GLB_CHUNK_BIN && !binary_chunk.data) {
+        binary_chunk = { data + offset, chunk_length };
+      }
+      
+      offset += (chunk_length + 3) & ~3u;
+    }
+    
+    if (json_size == 0) gltf_fail("missing json chunk");
+  }
+  
+  json_document_t document(json_data, json_size);
+  json_value_t root = document.root();
+  
+  std::vector<gltf_buffer_t> buffers;
+  std::vector<std::vector<char>> decoded;
+  std::vector<std::unique_ptr<mapped_file_t>> external;
+  
+  json_value_t buffer_list = root.get("buffers");
+  decoded.reserve(buffer_list.size());
+  
+  for (int i = 0; i < buffer_list.size(); i++) {
+    json_value_t buffer = buffer_list.at(i);
+    std::string_view uri = buffer.get("uri").as_string();
+    
+    if (uri.empty()) {
+      if (!binary_chunk.data) gltf_fail("buffer without a uri or binary chunk");
+      buffers.push_back(binary_chunk);
+    } else if (uri.substr(0, 5) == "data:") {
+      size_t comma = uri.find(',');
+      if (comma == std::string_view::npos) gltf_fail("malformed data uri");
+      
+      std::vector<char>& bytes = decoded.emplace_back(base64_decode(uri.substr(comma + 1)));
+      buffers.push_back({ bytes.data(), bytes.size() });
+    } else {
+      mapped_file_t& file = *external.emplace_back(std::make_unique<mapped_file_t>(dir + std::string(uri)));
+      buffers.push_back({ file.data(), file.size() });
+    }
+  }
+  
+  thread_pool_t& pool = thread_pool_t::shared();
+  int num_chunks = pool.size() + 1;
+  
+  json_value_t meshes = root.get("meshes");
+  
+  for (int m = 0; m < meshes.size(); m++) {
+    json_value_t primitives = meshes.at(m).get("primitives");
+    
+    for (int p = 0; p < primitives.size(); p++) {
+      json_value_t primitive = primitives.at(p);
+      json_value_t attributes = primitive.get("attributes");
+      
+      // points, lines and strips have no place in a triangle list
+      if (primitive.get("mode").as_int(GLTF_TRIANGLES) != GLTF_TRIANGLES) continue;
+      if (!attributes.get("POSITION").is_valid()) continue;
+      
+      gltf_accessor_t positions = gltf_accessor(root, attributes.get("POSITION").as_int(), buffers);
+      gltf_accessor_t normals = positions;
+      gltf_accessor_t uvs = positions;
+      gltf_accessor_t indices = positions;
+      
+      bool has_normals = attributes.get("NORMAL").is_valid();
+      bool has_uvs = attributes.get("TEXCOORD_0").is_valid();
+      bool has_indices = primitive.get("indices").is_valid();
+      
+      if (has_normals) normals = gltf_accessor(root, attributes.get("NORMAL").as_int(), buffers);
+      if (has_uvs) uvs = gltf_accessor(root, attributes.get("TEXCOORD_0").as_int(), buffers);
+      if (has_indices) indices = gltf_accessor(root, primitive.get("indices").as_int(), buffers);
+      
+      if (positions.components != 3) gltf_fail("positions must be vec3");
+      if (has_normals && (normals.components != 3 || normals.count < positions.count)) gltf_fail("normals must be vec3 per position");
+      if (has_uvs && (uvs.components != 2 || uvs.count < positions.count)) gltf_fail("uvs must be vec2 per position");
+      if (has_indices && indices.components != 1) gltf_fail("indices must be scalar");
+      
+      int num_triangles = (has_indices ? indices.count : positions.count) / 3;
+      vertex_t* vertices = mesh_builder.push_vertices(num_triangles * 3);
+      std::atomic<bool> valid(true);
+      
+      pool.parallel_for(num_triangles, num_chunks, [&](int chunk, int begin, int end) {
+        for (int triangle = begin; triangle < end; triangle++) {
+          uint32_t corner[3];
+          
+          for (int k = 0; k < 3; k++) {
+            corner[k] = has_indices ? indices.read_index(triangle * 3 + k) : triangle * 3 + k;
+            
+            if (corner[k] >= (uint32_t) positions.count) {
+              valid = false;
+              return;
+            }
+          }
+          
+          vec3 pos[3];
+          for (int k = 0; k < 3; k++) {
+            pos[k] = vec3(positions.read(corner[k], 0), positions.read(corner[k], 1), positions.read(corner[k], 2));
+          }
+          
+          vec3 flat = face_normal(pos[0], pos[1], pos[2]);
+          
+          for (int k = 0; k < 3; k++) {
+            vec3 normal = has_normals ? vec3(normals.read(corner[k], 0), normals.read(corner[k], 1), normals.read(corner[k], 2)) : flat;
+            
+            // glTF's top-left uv origin matches how texture_t uploads images
+            vec2 uv = has_uvs ? vec2(uvs.read(corner[k], 0), uvs.read(corner[k], 1)) : vec2(0.0);
+            
+            vertices[triangle * 3 + k] = vertex_t(pos[k], normal, uv);
+          }
+        }
+      });
+      
+      if (!valid) gltf_fail("index out of range");
+    }
+  }
+}
@@ -0,0 +1,15 @@
+#ifndef MESH_IMPORTER_H
+#define MESH_IMPORTER_H
+
+#include "mesh_builder.hpp"
+#include <string>
+
+// Appends the triangles of an OBJ, glTF or GLB file to the builder. The file
+// is memory-mapped and parsed in chunks on the shared thread pool. glTF node
+// transforms are not applied: every mesh is read in its own space.
+void import_mesh(mesh_builder_t& mesh_builder, const std::string& path);
+
+void import_obj(mesh_builder_t& mesh_builder, const char* data, size_t size);
+void import_gltf(mesh_builder_t& mesh_builder, const char* data, size_t size, const std::string& dir);
+
+#endif
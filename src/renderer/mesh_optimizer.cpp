@@ -0,0 +1,318 @@
+#include "mesh_optimizer.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+triangle_adjacency_t::triangle_adjacency_t() {
+  
+}
+
+triangle_adjacency_t::triangle_adjacency_t(const std::vector<unsigned short>& indices, int vertex_count) {
+  build(indices, vertex_count);
+}
+
+void triangle_adjacency_t::build(const std::vector<unsigned short>& indices, int vertex_count) {
+  offsets.assign(vertex_count + 1, 0);
+  triangles.resize(indices.size());
+  
+  for (unsigned short index : indices) {
+    offsets[index + 1]++;
+  }
+  
+  for (int v = 0; v < vertex_count; v++) {
+    offsets[v + 1] += offsets[v];
+  }
+  
+  cursor.assign(offsets.begin(), offsets.end() - 1);
+  
+  for (unsigned int i = 0; i < indices.size(); i++) {
+    triangles[cursor[indices[i]]++] = i / 3;
+  }
+}
+
+static int tipsify_next(
+  const std::vector<int>& candidates,
+  const std::vector<int>& live,
+  const std::vector<int>& cache_time,
+  std::vector<int>& dead_end,
+  int& cursor,
+  int time,
+  int cache_size,
+  bool& from_cache
+) {
+  int best = -1;
+  int best_priority = -1;
+  
+  for (int v : candidates) {
+    if (live[v] <= 0) continue;
+    
+    // prefer the oldest vertex that will still be in the cache after its fan
+    int priority = 0;
+    if (time - cache_time[v] + 2 * live[v] <= cache_size) {
+      priority = time - cache_time[v];
+    }
+    
+    if (priority > best_priority) {
+      best_priority = priority;
+      best = v;
+    }
+  }
+  
+  from_cache = best >= 0;
+  if (best >= 0) return best;
+  
+  while (!dead_end.empty()) {
+    int v = dead_end.back();
+    dead_end.pop_back();
+    if (live[v] > 0) return v;
+  }
+  
+  while (cursor < (int) live.size()) {
+    if (live[cursor] > 0) return cursor;
+    cursor++;
+  }
+  
+  return -1;
+}
+
+void optimize_vertex_cache(std::vector<unsigned short>& indices, int vertex_count, int cache_size, std::vector<int>& clusters) {
+  int num_triangles = (int) indices.size() / 3;
+  
+  static thread_local triangle_adjacency_t adjacency;
+  static thread_local std::vector<int> live;
+  static thread_local std::vector<int> cache_time;
+  static thread_local std::vector<char> emitted;
+  static thread_local std::vector<int> dead_end;
+  static thread_local std::vector<int> candidates;
+  static thread_local std::vector<unsigned short> result;
+  
+  adjacency.build(indices, vertex_count);
+  
+  live.resize(vertex_count);
+  for (int v = 0; v < vertex_count; v++) {
+    live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+  }
+  
+  cache_time.assign(vertex_count, 0);
+  emitted.assign(num_triangles, false);
+  dead_end.clear();
+  candidates.clear();
+  result.clear();
+  clusters.clear();
+  
+  int time = cache_size + 1;
+  int cursor = 0;
+  int fan = num_triangles > 0 ? 0 : -1;
+  bool from_cache = false;
+  
+  while (fan >= 0) {
+    candidates.clear();
+    
+    if (!from_cache) {
+      clusters.push_back((int) result.size() / 3);
+    }
+    
+    for (int i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1]; i++) {
+      int triangle = adjacency.triangles[i];
+      if (emitted[triangle]) continue;
+      
+      for (int k = 0; k < 3; k++) {
+        int v = indices[triangle * 3 + k];
+        result.push_back(v);
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        
+        if (time - cache_time[v] > cache_size) {
+          cache_time[v] = time++;
+        }
+      }
+      
+      emitted[triangle] = true;
+    }
+    
+    fan = tipsify_next(candidates, live, cache_time, dead_end, cursor, time, cache_size, from_cache);
+  }
+  
+  // both buffers keep their capacity for the next call
+  indices.swap(result);
+}
+
+void optimize_overdraw(std::vector<unsigned short>& indices, const std::vector<int>& clusters, const std::vector<vec3>& positions) {
+  int num_triangles = (int) indices.size() / 3;
+  int num_clusters = (int) clusters.size();
+  
+  if (num_clusters < 2) return;
+  
+  vec3 mesh_centroid = vec3(0.0);
+  float mesh_area = 0.0f;
+  
+  static thread_local std::vector<vec3> cluster_centroid;
+  static thread_local std::vector<vec3> cluster_normal;
+  static thread_local std::vector<float> cluster_area;
+  static thread_local std::vector<float> sort_key;
+  static thread_local std::vector<int> order;
+  static thread_local std::vector<unsigned short> result;
+  
+  cluster_centroid.assign(num_clusters, vec3(0.0));
+  cluster_normal.assign(num_clusters, vec3(0.0));
+  cluster_area.assign(num_clusters, 0.0f);
+  
+  for (int c = 0; c < num_clusters; c++) {
+    int end = c + 1 < num_clusters ? clusters[c + 1] : num_triangles;
+    
+    for (int t = clusters[c]; t < end; t++) {
+      vec3 a = positions[indices[t * 3 + 0]];
+      vec3 b = positions[indices[t * 3 + 1]];
+      vec3 d = positions[indices[t * 3 + 2]];
+      
+      vec3 normal = vec3::cross(b - a, d - a);
+      float area = normal.length();
+      vec3 centroid = (a + b + d) * (1.0f / 3.0f);
+      
+      cluster_centroid[c] += centroid * area;
+      cluster_normal[c] += normal;
+      cluster_area[c] += area;
+      mesh_centroid += centroid * area;
+      mesh_area += area;
+    }
+  }
+  
+  if (mesh_area > 0.0f) {
+    mesh_centroid *= 1.0f / mesh_area;
+  }
+  
+  sort_key.resize(num_clusters);
+  order.resize(num_clusters);
+  
+  for (int c = 0; c < num_clusters; c++) {
+    vec3 centroid = cluster_area[c] > 0.0f ? cluster_centroid[c] * (1.0f / cluster_area[c]) : mesh_centroid;
+    vec3 normal = cluster_normal[c].length_squared() > 0.0f ? cluster_normal[c].normalize() : vec3(0.0);
+    
+    sort_key[c] = vec3::dot(centroid - mesh_centroid, normal);
+    order[c] = c;
+  }
+  
+  // ties keep their original order without stable_sort's temporary buffer
+  std::sort(order.begin(), order.end(), [](int a, int b) {
+    return sort_key[a] != sort_key[b] ? sort_key[a] > sort_key[b] : a < b;
+  });
+  
+  result.clear();
+  
+  for (int c : order) {
+    int end = c + 1 < num_clusters ? clusters[c + 1] : num_triangles;
+    result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+  }
+  
+  indices.swap(result);
+}
+
+void optimize_vertex_fetch(std::vector<unsigned short>& indices, int vertex_count, std::vector<int>& order) {
+  static thread_local std::vector<int> remap;
+  
+  remap.assign(vertex_count, -1);
+  order.clear();
+  
+  for (unsigned short& index : indices) {
+    if (remap[index] < 0) {
+      remap[index] = (int) order.size();
+      order.push_back(index);
+    }
+    
+    index = (unsigned short) remap[index];
+  }
+}
+
+float analyze_acmr(const std::vector<unsigned short>& indices, int vertex_count, int cache_size) {
+  if (indices.empty()) return 0.0f;
+  
+  std::vector<int> cache_time(vertex_count, -cache_size - 1);
+  int time = 0;
+  int misses = 0;
+  
+  for (unsigned short index : indices) {
+    if (time - cache_time[index] > cache_size) {
+      cache_time[index] = time++;
+      misses++;
+    }
+  }
+  
+  return misses / (float) (indices.size() / 3);
+}
+
+// Rasterises the mesh orthographically along each axis in both directions
+// with a depth test and returns shaded / covered pixels. Culling is off, as
+// it is in the renderer.
+float analyze_overdraw(const std::vector<unsigned short>& indices, const std::vector<vec3>& positions) {
+  static const int GRID = 256;
+  
+  if (indices.empty()) return 0.0f;
+  
+  vec3 bounds_min = positions[indices[0]];
+  vec3 bounds_max = bounds_min;
+  
+  for (unsigned short index : indices) {
+    bounds_min = vec3::min(bounds_min, positions[index]);
+    bounds_max = vec3::max(bounds_max, positions[index]);
+  }
+  
+  vec3 extent = bounds_max - bounds_min;
+  float scale = std::max(extent.x, std::max(extent.y, extent.z));
+  if (scale <= 0.0f) return 1.0f;
+  
+  std::vector<float> depth(GRID * GRID);
+  long shaded = 0;
+  long covered = 0;
+  
+  for (int view = 0; view < 6; view++) {
+    int axis = view / 2;
+    float sign = view % 2 ? -1.0f : 1.0f;
+    
+    std::fill(depth.begin(), depth.end(), FLT_MAX);
+    
+    for (unsigned int i = 0; i < indices.size(); i += 3) {
+      float x[3], y[3], z[3];
+      
+      for (int k = 0; k < 3; k++) {
+        vec3 p = (positions[indices[i + k]] - bounds_min) * (1.0f / scale);
+        float c[3] = { p.x, p.y, p.z };
+        x[k] = c[(axis + 1) % 3] * (GRID - 1);
+        y[k] = c[(axis + 2) % 3] * (GRID - 1);
+        z[k] = c[axis] * sign;
+      }
+      
+      float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+      if (area == 0.0f) continue;
+      
+      int x0 = std::max(0, (int) floorf(std::min(x[0], std::min(x[1], x[2]))));
+      int x1 = std::min(GRID - 1, (int) ceilf(std::max(x[0], std::max(x[1], x[2]))));
+      int y0 = std::max(0, (int) floorf(std::min(y[0], std::min(y[1], y[2]))));
+      int y1 = std::min(GRID - 1, (int) ceilf(std::max(y[0], std::max(y[1], y[2]))));
+      
+      for (int py = y0; py <= y1; py++) {
+        for (int px = x0; px <= x1; px++) {
+          float fx = px + 0.5f;
+          float fy = py + 0.5f;
+          
+          float w0 = ((x[1] - fx) * (y[2] - fy) - (x[2] - fx) * (y[1] - fy)) / area;
+          float w1 = ((x[2] - fx) * (y[0] - fy) - (x[0] - fx) * (y[2] - fy)) / area;
+          float w2 = 1.0f - w0 - w1;
+          
+          if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+          
+          float d = w0 * z[0] + w1 * z[1] + w2 * z[2];
+          float& stored = depth[py * GRID + px];
+          
+          if (d < stored) {
+            if (stored == FLT_MAX) covered++;
+            stored = d;
+            shaded++;
+          }
+        }
+      }
+    }
+  }
+  
+  return covered ? shaded / (float) covered : 1.0f;
+}
@@ -0,0 +1,58 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <util/math3d.hpp>
+#include <ostream>
+#include <vector>
+
+static const int VERTEX_CACHE_SIZE = 16;
+
+class mesh_stats_t {
+public:
+  int num_triangles;
+  float acmr_before;
+  float acmr_after;
+  float overdraw_before;
+  float overdraw_after;
+  
+  inline friend std::ostream& operator<<(std::ostream& stream, const mesh_stats_t& stats) {
+    stream << stats.num_triangles << " triangles, "
+      << "ACMR " << stats.acmr_before << " -> " << stats.acmr_after << ", "
+      << "overdraw " << stats.overdraw_before << " -> " << stats.overdraw_after;
+    return stream;
+  }
+};
+
+// The triangles using each vertex, as offsets into one flat list. build() can
+// be called again on new indices and reuses the existing storage.
+class triangle_adjacency_t {
+public:
+  std::vector<int> offsets;
+  std::vector<int> triangles;
+  std::vector<int> cursor;
+  
+  triangle_adjacency_t();
+  triangle_adjacency_t(const std::vector<unsigned short>& indices, int vertex_count);
+  void build(const std::vector<unsigned short>& indices, int vertex_count);
+};
+
+// The optimizers keep their working memory in thread-local buffers, so
+// rebuilding meshes of a similar size stops allocating after the first pass.
+
+// Tipsify: reorders triangles for a FIFO post-transform cache and fills
+// clusters with the first triangle of each cluster (split where the cache
+// flushes).
+void optimize_vertex_cache(std::vector<unsigned short>& indices, int vertex_count, int cache_size, std::vector<int>& clusters);
+
+// Sorts clusters so outward-facing ones are drawn first, which lets early
+// depth rejection skip more of the clusters behind them.
+void optimize_overdraw(std::vector<unsigned short>& indices, const std::vector<int>& clusters, const std::vector<vec3>& positions);
+
+// Fills order with the old vertex index for each new vertex, in order of
+// first use, and rewrites the indices to match.
+void optimize_vertex_fetch(std::vector<unsigned short>& indices, int vertex_count, std::vector<int>& order);
+
+float analyze_acmr(const std::vector<unsigned short>& indices, int vertex_count, int cache_size);
+float analyze_overdraw(const std::vector<unsigned short>& indices, const std::vector<vec3>& positions);
+
+#endif
@@ -0,0 +1,261 @@
+#include "mesh_simplifier.hpp"
+#include "mesh_optimizer.hpp"
+#include <util/hash.hpp>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+// Sum of squared distances to a set of area-weighted planes, divided by the
+// total weight when evaluated so the error reads as a distance.
+class quadric_t {
+public:
+  double a00, a01, a02, a11, a12, a22;
+  double b0, b1, b2;
+  double c;
+  double w;
+  
+  quadric_t() {
+    memset(this, 0, sizeof(quadric_t));
+  }
+  
+  quadric_t(vec3 n, float d, float weight) {
+    a00 = n.x * n.x * weight;  a01 = n.x * n.y * weight;  a02 = n.x * n.z * weight;
+    a11 = n.y * n.y * weight;  a12 = n.y * n.z * weight;  a22 = n.z * n.z * weight;
+    b0 = n.x * d * weight;  b1 = n.y * d * weight;  b2 = n.z * d * weight;
+    c = (double) d * d * weight;
+    w = weight;
+  }
+  
+  quadric_t& operator+=(const quadric_t& q) {
+    a00 += q.a00;  a01 += q.a01;  a02 += q.a02;
+    a11 += q.a11;  a12 += q.a12;  a22 += q.a22;
+    b0 += q.b0;  b1 += q.b1;  b2 += q.b2;
+    c += q.c;
+    w += q.w;
+    return *this;
+  }
+  
+  float error(vec3 p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double e =
+      a00 * x * x + a11 * y * y + a22 * z * z +
+      2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+      2.0 * (b0 * x + b1 * y + b2 * z) +
+      c;
+    return w > 0.0 ? (float) std::max(0.0, e / w) : 0.0f;
+  }
+};
+
+class collapse_t {
+public:
+  int from;
+  int to;
+  float error;
+};
+
+static std::vector<bool> simplify_locked(const std::vector<unsigned short>& indices, const std::vector<vec3>& positions) {
+  int vertex_count = (int) positions.size();
+  std::vector<bool> locked(vertex_count, false);
+  
+  // vertices split along uv or normal seams share a position
+  std::vector<int> position_id(vertex_count);
+  std::vector<int> position_count;
+  std::unordered_map<uint64_t, std::vector<int>> buckets;
+  
+  for (int v = 0; v < vertex_count; v++) {
+    vec3 p = positions[v];
+    std::vector<int>& bucket = buckets[hash_bytes(&p, sizeof(vec3))];
+    
+    int id = -1;
+    for (int other : bucket) {
+      if (memcmp(&positions[other], &p, sizeof(vec3)) == 0) {
+        id = position_id[other];
+        break;
+      }
+    }
+    
+    if (id < 0) {
+      id = (int) position_count.size();
+      position_count.push_back(0);
+    }
+    
+    bucket.push_back(v);
+    position_id[v] = id;
+    position_count[id]++;
+  }
+  
+  // an edge used by only one triangle lies on an open border
+  std::unordered_map<unsigned long long, int> edges;
+  
+  for (unsigned int i = 0; i < indices.size(); i += 3) {
+    for (int k = 0; k < 3; k++) {
+      unsigned int a = position_id[indices[i + k]];
+      unsigned int b = position_id[indices[i + (k + 1) % 3]];
+      if (a > b) std::swap(a, b);
+      edges[((unsigned long long) a << 32) | b]++;
+    }
+  }
+  
+  std::vector<bool> border(position_count.size(), false);
+  
+  for (const auto& [key, count] : edges) {
+    if (count == 1) {
+      border[key >> 32] = true;
+      border[key & 0xffffffff] = true;
+    }
+  }
+  
+  for (int v = 0; v < vertex_count; v++) {
+    locked[v] = position_count[position_id[v]] > 1 || border[position_id[v]];
+  }
+  
+  return locked;
+}
+
+// Rejects a collapse that would flip or fold any surviving triangle around
+// from.
+static bool simplify_flips(
+  const std::vector<unsigned short>& indices,
+  const std::vector<vec3>& positions,
+  const triangle_adjacency_t& adjacency,
+  int from,
+  int to
+) {
+  for (int i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; i++) {
+    int triangle = adjacency.triangles[i];
+    int a = indices[triangle * 3 + 0];
+    int b = indices[triangle * 3 + 1];
+    int c = indices[triangle * 3 + 2];
+    
+    if (a == to || b == to || c == to) continue;
+    
+    vec3 p[3] = { positions[a], positions[b], positions[c] };
+    vec3 before = vec3::cross(p[1] - p[0], p[2] - p[0]);
+    
+    if (a == from) p[0] = positions[to];
+    if (b == from) p[1] = positions[to];
+    if (c == from) p[2] = positions[to];
+    
+    vec3 after = vec3::cross(p[1] - p[0], p[2] - p[0]);
+    
+    // also rejects collapses that fold a triangle most of the way over
+    if (vec3::dot(before, after) <= 0.25f * before.length() * after.length()) return true;
+  }
+  
+  return false;
+}
+
+float simplify(
+  std::vector<unsigned short>& indices,
+  const std::vector<vec3>& positions,
+  int target_index_count,
+  float max_error
+) {
+  int vertex_count = (int) positions.size();
+  std::vector<bool> locked = simplify_locked(indices, positions);
+  std::vector<quadric_t> quadrics(vertex_count);
+  
+  for (unsigned int i = 0; i < indices.size(); i += 3) {
+    vec3 p0 = positions[indices[i + 0]];
+    vec3 p1 = positions[indices[i + 1]];
+    vec3 p2 = positions[indices[i + 2]];
+    
+    vec3 normal = vec3::cross(p1 - p0, p2 - p0);
+    float area = normal.length();
+    if (area <= 0.0f) continue;
+    
+    normal = normal * (1.0f / area);
+    quadric_t plane(normal, -vec3::dot(normal, p0), area);
+    
+    for (int k = 0; k < 3; k++) {
+      quadrics[indices[i + k]] += plane;
+    }
+  }
+  
+  float max_error_squared = max_error * max_error;
+  float reached = 0.0f;
+  
+  std::vector<collapse_t> collapses;
+  std::vector<int> remap(vertex_count);
+  std::vector<bool> touched(vertex_count);
+  
+  while ((int) indices.size() > target_index_count) {
+    triangle_adjacency_t adjacency(indices, vertex_count);
+    collapses.clear();
+    
+    for (unsigned int i = 0; i < indices.size(); i += 3) {
+      for (int k = 0; k < 3; k++) {
+        int a = indices[i + k];
+        int b = indices[i + (k + 1) % 3];
+        
+        for (int flip = 0; flip < 2; flip++) {
+          if (!locked[a]) {
+            quadric_t q = quadrics[a];
+            q += quadrics[b];
+            collapses.push_back({ a, b, q.error(positions[b]) });
+          }
+          std::swap(a, b);
+        }
+      }
+    }
+    
+    std::sort(collapses.begin(), collapses.end(), [](const collapse_t& x, const collapse_t& y) {
+      return x.error < y.error;
+    });
+    
+    for (int v = 0; v < vertex_count; v++) {
+      remap[v] = v;
+    }
+    std::fill(touched.begin(), touched.end(), false);
+    
+    int triangles = (int) indices.size() / 3;
+    int target_triangles = target_index_count / 3;
+    int num_collapsed = 0;
+    
+    for (const collapse_t& collapse : collapses) {
+      if (triangles <= target_triangles) break;
+      if (collapse.error > max_error_squared) break;
+      if (touched[collapse.from] || touched[collapse.to]) continue;
+      if (simplify_flips(indices, positions, adjacency, collapse.from, collapse.to)) continue;
+      
+      // everything around from is touched so later flip tests stay valid
+      for (int i = adjacency.offsets[collapse.from]; i < adjacency.offsets[collapse.from + 1]; i++) {
+        int triangle = adjacency.triangles[i];
+        bool shared = false;
+        
+        for (int k = 0; k < 3; k++) {
+          int v = indices[triangle * 3 + k];
+          touched[v] = true;
+          if (v == collapse.to) shared = true;
+        }
+        
+        if (shared) triangles--;
+      }
+      
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      reached = std::max(reached, collapse.error);
+      num_collapsed++;
+    }
+    
+    if (num_collapsed == 0) break;
+    
+    unsigned int write = 0;
+    
+    for (unsigned int i = 0; i < indices.size(); i += 3) {
+      int a = remap[indices[i + 0]];
+      int b = remap[indices[i + 1]];
+      int c = remap[indices[i + 2]];
+      
+      if (a == b || b == c || c == a) continue;
+      
+      indices[write++] = (unsigned short) a;
+      indices[write++] = (unsigned short) b;
+      indices[write++] = (unsigned short) c;
+    }
+    
+    indices.resize(write);
+  }
+  
+  return sqrtf(reached);
+}
@@ -0,0 +1,18 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <util/math3d.hpp>
+#include <vector>
+
+// Collapses edges onto existing vertices in order of quadric error until at
+// most target_index_count indices remain or the next collapse would move the
+// surface further than max_error. Vertices on open borders or attribute seams
+// (positions shared by several vertices) are locked. Returns the error reached.
+float simplify(
+  std::vector<unsigned short>& indices,
+  const std::vector<vec3>& positions,
+  int target_index_count,
+  float max_error
+);
+
+#endif
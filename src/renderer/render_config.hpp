@@ -0,0 +1,61 @@
+#ifndef RENDER_CONFIG_H
+#define RENDER_CONFIG_H
+
+#include "lighting.hpp"
+#include "shader_builder.hpp"
+
+static const float Z_NEAR = 0.1;
+static const float Z_FAR = 100.0;
+
+// a coarser LOD is only taken once its error is this fraction of the limit,
+// so entities near a switching distance don't flicker between levels
+static const float LOD_HYSTERESIS = 0.75;
+
+enum quality_t {
+  QUALITY_LOW,
+  QUALITY_MEDIUM,
+  QUALITY_HIGH
+};
+
+class render_config_t {
+public:
+  quality_t quality;
+  int ssao_samples;
+  int ssr_steps;
+  float lod_pixel_error;
+  
+  inline render_config_t(quality_t _quality) {
+    quality = _quality;
+    
+    switch (quality) {
+    case QUALITY_LOW:
+      ssao_samples = 8;
+      ssr_steps = 32;
+      lod_pixel_error = 2.0;
+      break;
+    case QUALITY_MEDIUM:
+      ssao_samples = 16;
+      ssr_steps = 64;
+      lod_pixel_error = 1.0;
+      break;
+    case QUALITY_HIGH:
+      ssao_samples = 32;
+      ssr_steps = 128;
+      lod_pixel_error = 0.5;
+      break;
+    }
+  }
+  
+  // shaders get these instead of their own copies, so loop bounds are known
+  // at compile time and each quality tier is its own cached program variant
+  inline shader_defines_t defines() const {
+    shader_defines_t defines;
+    shader_define(defines, "MAX_LIGHTS", MAX_LIGHTS);
+    shader_define(defines, "SSAO_SAMPLES", ssao_samples);
+    shader_define(defines, "SSR_STEPS", ssr_steps);
+    shader_define(defines, "SSR_STEP_DIVISOR", ssr_steps / 4.0f);
+    return defines;
+  }
+};
+
+#endif
@@ -1,13 +1,18 @@
 #include "renderer.hpp"
 #include "mesh_builder.hpp"
+#include "mesh_cache.hpp"
 #include "shader_builder.hpp"
+#include <cmath>
 #include <iostream>
 
 #define BUFFER_WIDTH 400
 #define BUFFER_HEIGHT 400
+#define TEXTURE_UPLOAD_BUDGET (4 << 20)
 
-renderer_t::renderer_t(game_t& game)
-  : m_vertex_buffer(256),
+renderer_t::renderer_t(game_t& game, quality_t quality)
+  : m_config(quality),
+    m_defines(m_config.defines()),
+    m_vertex_buffer(4096, 16384),
     m_game(game),
     m_depth(BUFFER_WIDTH, BUFFER_HEIGHT, GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT16, GL_FLOAT),
     m_normal(texture_t(BUFFER_WIDTH, BUFFER_HEIGHT, GL_RGBA, GL_RGBA16F, GL_FLOAT)),
@@ -26,36 +31,46 @@ renderer_t::renderer_t(game_t& game)
     }),
     m_gbuffer(
       shader_builder_t()
+      .define(m_defines)
       .source_vertex_shader("assets/planar-map.vert")
       .source_fragment_shader("assets/gbuffer.frag")
       .attach(m_camera)
       .attach(m_lighting)
       .bind("u_albedo", 0)
       .bind("u_normal", 1)
-      .bind("u_roughness", 2)
+      .bind("u_orm", 2)
       .compile()
     ),
     m_point_light_scatter(
       shader_builder_t()
+      .define(m_defines)
       .source_deferred_shader("assets/point-light-scatter.frag")
       .attach(m_camera)
+      .attach(m_frame)
       .attach(m_lighting)
       .compile()
     ),
     m_water(
       shader_builder_t()
+      .define(m_defines)
       .source_deferred_shader("assets/water.frag")
       .attach(m_camera)
+      .attach(m_frame)
       .compile()
     ),
-    m_ssr(shader_builder_t().source_deferred_shader("assets/ssr.frag").compile()),
-    m_ssao(shader_builder_t().source_deferred_shader("assets/ssao.frag").compile()),
-    m_dither(shader_builder_t().source_frame_shader("assets/dither.frag").compile()),
-    m_tone_map(shader_builder_t().source_frame_shader("assets/tone-map.frag").compile())
+    m_ssr(shader_builder_t().define(m_defines).source_deferred_shader("assets/ssr.frag").attach(m_frame).compile()),
+    m_ssao(shader_builder_t().define(m_defines).source_deferred_shader("assets/ssao.frag").attach(m_frame).compile()),
+    m_dither(shader_builder_t().define(m_defines).source_frame_shader("assets/dither.frag").compile()),
+    m_tone_map(shader_builder_t().define(m_defines).source_frame_shader("assets/tone-map.frag").compile()),
+    m_entity_commands(thread_pool_t::shared().size() + 1),
+    m_entity_lods(MAX_ENTITIES, 0),
+    m_entity_matrices(MAX_ENTITIES)
 {
+  m_entity_transforms.resize(MAX_ENTITIES);
+
   std::vector<vec3> samples;
   
-  for (int i = 0; i < 32; i++) {
+  for (int i = 0; i < m_config.ssao_samples; i++) {
     float x = (rand() % 256) / 256.0f * 2.0 - 1.0;
     float y = (rand() % 256) / 256.0f * 2.0 - 1.0;
     float z = (rand() % 256) / 256.0f;
@@ -64,7 +79,9 @@ renderer_t::renderer_t(game_t& game)
     samples.push_back(vec3(x, y, z).normalize() * t);
   }
 
-  m_ssao.uniform_vec3_array("u_samples", samples);
+  m_ssao.on_ready([samples](shader_t& shader) {
+    shader.uniform_vec3_array("u_samples", samples);
+  });
 
   m_textures.reserve(64);
   init_assets();
@@ -76,116 +93,236 @@ void renderer_t::bind() {
   m_vertex_buffer.bind();
 }
 
-float t = 0.0;
-
 void renderer_t::render() {
-  t += 0.01;
+  stream_textures();
+  update_world();
+  m_vertex_buffer.compact(1);
 
   transform_t &camera_transform = m_game.get_transform(m_game.get_camera());
   
   m_camera.move(camera_transform.position, camera_transform.rotation);
+  m_frame.update(m_camera, BUFFER_WIDTH, BUFFER_HEIGHT, 0.01);
+  
+  m_gbuffer_commands.reset();
+  m_gbuffer_commands.begin_pass(&m_gbuffer_target, BUFFER_WIDTH, BUFFER_HEIGHT);
+  
+  if (m_gbuffer.is_ready()) {
+    m_gbuffer_commands.bind_shader(m_gbuffer);
+    draw_world();
+    draw_entities();
+  } else {
+    for (command_buffer_t& entity_commands : m_entity_commands) {
+      entity_commands.reset();
+    }
+  }
   
-  m_gbuffer_target.bind();
-  glViewport(0, 0, BUFFER_WIDTH, BUFFER_HEIGHT);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  m_gbuffer.bind();
-  draw_entities();
-  m_gbuffer_target.unbind();
+  m_post_commands.reset();
+  m_post_commands.end_pass(&m_gbuffer_target);
 
+  // passes whose programs are still compiling are skipped and leave the
+  // previous pass's output in place
   int c = 0;
   
-  m_normal.bind(1);
-  m_depth.bind(2);
-  
-  m_target[!c].bind();
-  m_buffer[c].bind(0);
-  draw_buffer(BUFFER_WIDTH, BUFFER_HEIGHT, m_ssr);
-  m_target[!c].unbind();
-  c = !c;
-  
-  m_target[!c].bind();
-  m_buffer[c].bind(0);
-  draw_buffer(BUFFER_WIDTH, BUFFER_HEIGHT, m_ssao);
-  m_target[!c].unbind();
-  c = !c;
-
-  m_target[!c].bind();
-  m_buffer[c].bind(0);
-  m_water.uniform_float("g_time", t);
-  draw_buffer(BUFFER_WIDTH, BUFFER_HEIGHT, m_water);
-  m_target[!c].unbind();
-  c = !c;
-
-  m_target[!c].bind();
-  m_buffer[c].bind(0);
-  draw_buffer(BUFFER_WIDTH, BUFFER_HEIGHT, m_point_light_scatter);
-  m_target[!c].unbind();
-  c = !c;
-
-  m_target[!c].bind();
-  m_buffer[c].bind(0);
-  draw_buffer(BUFFER_WIDTH, BUFFER_HEIGHT, m_tone_map);
-  m_target[!c].unbind();
-  c = !c;
-  
-  m_buffer[c].bind(0);
-  draw_buffer(800, 800, m_dither);
+  m_post_commands.bind_texture(m_normal, 1);
+  m_post_commands.bind_texture(m_depth, 2);
+  
+  m_post_commands.bind_texture(m_buffer[c], 0);
+  if (draw_buffer(&m_target[!c], BUFFER_WIDTH, BUFFER_HEIGHT, m_ssr)) c = !c;
+  
+  m_post_commands.bind_texture(m_buffer[c], 0);
+  if (draw_buffer(&m_target[!c], BUFFER_WIDTH, BUFFER_HEIGHT, m_ssao)) c = !c;
+
+  m_post_commands.bind_texture(m_buffer[c], 0);
+  if (draw_buffer(&m_target[!c], BUFFER_WIDTH, BUFFER_HEIGHT, m_water)) c = !c;
+
+  m_post_commands.bind_texture(m_buffer[c], 0);
+  if (draw_buffer(&m_target[!c], BUFFER_WIDTH, BUFFER_HEIGHT, m_point_light_scatter)) c = !c;
+
+  m_post_commands.bind_texture(m_buffer[c], 0);
+  if (draw_buffer(&m_target[!c], BUFFER_WIDTH, BUFFER_HEIGHT, m_tone_map)) c = !c;
+  
+  m_post_commands.bind_texture(m_buffer[c], 0);
+  draw_buffer(nullptr, 800, 800, m_dither);
+  
+  m_gbuffer_commands.replay();
+  
+  for (command_buffer_t& entity_commands : m_entity_commands) {
+    entity_commands.replay();
+  }
+  
+  m_post_commands.replay();
 }
 
-void renderer_t::draw_buffer(int width, int height, shader_t& shader) {
-  glViewport(0, 0, width, height);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  shader.bind();
-  m_meshes[MESH_PLANE].draw();
+bool renderer_t::draw_buffer(target_t* target, int width, int height, shader_t& shader) {
+  if (!shader.is_ready()) return false;
+  
+  m_post_commands.begin_pass(target, width, height);
+  m_post_commands.bind_shader(shader);
+  m_post_commands.draw(m_meshes[MESH_PLANE][0]);
+  m_post_commands.end_pass(target);
+  return true;
 }
 
-void renderer_t::draw_entities() {
+// Unrotated cuboids are static level geometry: they are handed to the world
+// mesher instead of being drawn one by one. Unchanged cuboids cost nothing,
+// and a moved one only rebuilds the chunks around it.
+void renderer_t::update_world() {
   for (entity_t entity = 0; entity < m_game.entity_count(); entity++) {
+    bool is_world = false;
+    
     if (m_game.has_component(entity, HAS_MODEL | HAS_TRANSFORM)) {
       transform_t& transform = m_game.get_transform(entity);
       model_t& model = m_game.get_model(entity);
       
-      mat4 T_rotation = mat4::rotate_zyx(transform.rotation);
-      mat4 T_translation = mat4::translate(transform.position);
-      mat4 T_scale = mat4::scale(transform.scale);
+      if (model.mesh == MESH_CUBOID && transform.rotation.is_identity()) {
+        m_world.set(entity, transform.position, transform.position + transform.scale, model.material);
+        is_world = true;
+      }
+    }
+    
+    if (!is_world) {
+      m_world.remove(entity);
+    }
+  }
+  
+  m_world.update(m_vertex_buffer);
+}
+
+void renderer_t::draw_world() {
+  for (const world_mesh_t& world_mesh : m_world.get_meshes()) {
+    const material_t& material = m_materials[world_mesh.material];
+    
+    m_camera.sub(m_gbuffer_commands, mat4::identity(), world_mesh.mesh.get_decode());
+    m_gbuffer_commands.bind_texture(material.albedo, 0);
+    m_gbuffer_commands.bind_texture(material.normal, 1);
+    m_gbuffer_commands.bind_texture(material.orm, 2);
+    m_gbuffer_commands.draw(world_mesh.mesh);
+  }
+}
+
+void renderer_t::draw_entities() {
+  int num_chunks = (int) m_entity_commands.size();
+  
+  thread_pool_t::shared().parallel_for(m_game.entity_count(), num_chunks, [this](int chunk, int begin, int end) {
+    record_entities(m_entity_commands[chunk], begin, end);
+  });
+}
+
+// Each chunk gathers its own entities' transforms and builds their world
+// matrices in one batch before recording.
+void renderer_t::record_entities(command_buffer_t& commands, entity_t begin, entity_t end) {
+  commands.reset();
+  
+  for (entity_t entity = begin; entity < end; entity++) {
+    const transform_t& transform = m_game.get_transform(entity);
+    m_entity_transforms.set(entity, transform.position, transform.rotation, transform.scale);
+  }
+  
+  m_entity_transforms.compute(begin, end, m_entity_matrices.data());
+  
+  for (entity_t entity = begin; entity < end; entity++) {
+    if (m_game.has_component(entity, HAS_MODEL | HAS_TRANSFORM) && !m_world.contains(entity)) {
+      transform_t& transform = m_game.get_transform(entity);
+      model_t& model = m_game.get_model(entity);
+      
+      const mat4& T_model = m_entity_matrices[entity];
+      std::vector<mesh_t>& parts = m_meshes[model.mesh];
+      
+      float max_scale = std::max(fabs(transform.scale.x), std::max(fabs(transform.scale.y), fabs(transform.scale.z)));
+      int lod = select_lod(entity, parts, T_model, max_scale);
       
-      m_camera.sub(T_rotation * T_scale * T_translation);
-      m_materials[model.material].albedo.bind(0);
-      m_materials[model.material].normal.bind(1);
-      m_materials[model.material].roughness.bind(2);
-      m_meshes[model.mesh].draw();
+      commands.bind_texture(m_materials[model.material].albedo, 0);
+      commands.bind_texture(m_materials[model.material].normal, 1);
+      commands.bind_texture(m_materials[model.material].orm, 2);
+      
+      for (mesh_t& mesh : parts) {
+        m_camera.sub(commands, T_model, mesh.get_decode());
+        commands.draw(mesh, lod);
+      }
     }
   }
 }
 
+// Picks the coarsest LOD whose error, projected at the distance of the mesh's
+// bounding sphere, stays under the configured pixel error. Only called for
+// entities in this chunk, so the per-entity state needs no locking. Parts of
+// a split mesh share one LOD: the nearest part's distance, the fewest LODs and
+// the largest error of each level are used, and locked part borders keep the
+// levels crack-free.
+int renderer_t::select_lod(entity_t entity, const std::vector<mesh_t>& parts, mat4 model, float max_scale) {
+  float distance = INFINITY;
+  int lod_count = MAX_MESH_LODS;
+  
+  for (const mesh_t& mesh : parts) {
+    vec3 center = (model * vec4(mesh.get_center(), 1)).get_xyz();
+    distance = std::min(distance, (center - m_camera.get_view_pos()).length() - mesh.get_radius() * max_scale);
+    lod_count = std::min(lod_count, mesh.get_lod_count());
+  }
+  
+  float pixels_per_unit = m_camera.get_focal_length() * (BUFFER_HEIGHT / 2.0f) / std::max(distance, Z_NEAR);
+  float limit = m_config.lod_pixel_error;
+  
+  int current = std::min(m_entity_lods[entity], lod_count - 1);
+  int lod = 0;
+  
+  for (int i = 1; i < lod_count; i++) {
+    float part_error = 0.0f;
+    for (const mesh_t& mesh : parts) {
+      part_error = std::max(part_error, mesh.get_lod_error(i));
+    }
+    
+    float error = part_error * max_scale * pixels_per_unit;
+    float threshold = i > current ? limit * LOD_HYSTERESIS : limit;
+    
+    if (error > threshold) break;
+    lod = i;
+  }
+  
+  m_entity_lods[entity] = lod;
+  return lod;
+}
+
+// Uploads decoded material textures a slice at a time so a frame never
+// stalls on more than TEXTURE_UPLOAD_BUDGET bytes of transfers.
+void renderer_t::stream_textures() {
+  int budget = TEXTURE_UPLOAD_BUDGET;
+  
+  for (texture_t& texture : m_textures) {
+    budget -= texture.stream(budget);
+  }
+}
+
 void renderer_t::init_assets() {
   mesh_builder_t mesh_builder;
 
   mesh_builder = mesh_builder_t();
   mesh_builder.push_quad(mat4::identity(), mat4::identity());
-  m_meshes.push_back(m_vertex_buffer.push(mesh_builder.compile()));
+  m_meshes.push_back({ m_vertex_buffer.push(mesh_builder.compile()) });
   
   mesh_builder = mesh_builder_t();
   mesh_builder.push_cuboid(vec3(0.0), vec3(1.0));
-  m_meshes.push_back(m_vertex_buffer.push(mesh_builder.compile()));
+  m_meshes.push_back({ m_vertex_buffer.push(mesh_builder.compile()) });
+  
+  m_meshes.push_back(mesh_cache_import(m_vertex_buffer, "assets/meshes/column.obj"));
+  m_meshes.push_back(mesh_cache_import(m_vertex_buffer, "assets/meshes/plinth.gltf"));
   
   texture_t& default_albedo = m_textures.emplace_back(1, 1, GL_RGBA, GL_RGBA32F, GL_UNSIGNED_BYTE, std::vector { 0xffffffffu });
   texture_t& default_normal = m_textures.emplace_back(1, 1, GL_RGBA, GL_RGBA32F, GL_UNSIGNED_BYTE, std::vector { 0xffff8080u });
-  texture_t& default_roughness = m_textures.emplace_back(1, 1, GL_RGBA, GL_RGBA32F, GL_UNSIGNED_BYTE, std::vector { 0xff101010u });
-  m_materials.push_back(material_t(default_albedo, default_normal, default_roughness));
-
-  texture_t& brick_albedo = m_textures.emplace_back("assets/brick/albedo.jpg");
-  texture_t& brick_normal = m_textures.emplace_back("assets/brick/normal.jpg");
-  texture_t& brick_roughness = m_textures.emplace_back("assets/brick/roughness.jpg");
-  m_materials.push_back(material_t(brick_albedo, brick_normal, brick_roughness));
-
-  texture_t& grass_albedo = m_textures.emplace_back("assets/grass/albedo.jpg");
-  texture_t& grass_normal = m_textures.emplace_back("assets/grass/normal.jpg");
-  texture_t& grass_roughness = m_textures.emplace_back("assets/grass/roughness.jpg");
-  m_materials.push_back(material_t(grass_albedo, grass_normal, grass_roughness));
-
-  texture_t& tile_albedo = m_textures.emplace_back("assets/tile/albedo.jpg");
-  texture_t& tile_normal = m_textures.emplace_back("assets/tile/normal.jpg");
-  texture_t& tile_roughness = m_textures.emplace_back("assets/tile/roughness.jpg");
-  m_materials.push_back(material_t(tile_albedo, tile_normal, tile_roughness));
+  texture_t& default_orm = m_textures.emplace_back(1, 1, GL_RGBA, GL_RGBA32F, GL_UNSIGNED_BYTE, std::vector { 0xff0d10ffu });
+  m_materials.push_back(material_t(default_albedo, default_normal, default_orm));
+
+  texture_t& brick_albedo = m_textures.emplace_back(texture_source_t(TEXTURE_COLOR, { "assets/brick/albedo.jpg" }), default_albedo);
+  texture_t& brick_normal = m_textures.emplace_back(texture_source_t(TEXTURE_NORMAL, { "assets/brick/normal.jpg" }), default_normal);
+  texture_t& brick_orm = m_textures.emplace_back(texture_source_t(TEXTURE_ORM, { "", "assets/brick/roughness.jpg", "" }), default_orm);
+  m_materials.push_back(material_t(brick_albedo, brick_normal, brick_orm));
+
+  texture_t& grass_albedo = m_textures.emplace_back(texture_source_t(TEXTURE_COLOR, { "assets/grass/albedo.jpg" }), default_albedo);
+  texture_t& grass_normal = m_textures.emplace_back(texture_source_t(TEXTURE_NORMAL, { "assets/grass/normal.jpg" }), default_normal);
+  texture_t& grass_orm = m_textures.emplace_back(texture_source_t(TEXTURE_ORM, { "", "assets/grass/roughness.jpg", "" }), default_orm);
+  m_materials.push_back(material_t(grass_albedo, grass_normal, grass_orm));
+
+  texture_t& tile_albedo = m_textures.emplace_back(texture_source_t(TEXTURE_COLOR, { "assets/tile/albedo.jpg" }), default_albedo);
+  texture_t& tile_normal = m_textures.emplace_back(texture_source_t(TEXTURE_NORMAL, { "assets/tile/normal.jpg" }), default_normal);
+  texture_t& tile_orm = m_textures.emplace_back(texture_source_t(TEXTURE_ORM, { "", "assets/tile/roughness.jpg", "" }), default_orm);
+  m_materials.push_back(material_t(tile_albedo, tile_normal, tile_orm));
 }
@@ -2,21 +2,32 @@
 #define RENDERER_H
 
 #include "camera.hpp"
+#include "frame.hpp"
 #include "material.hpp"
 #include "lighting.hpp"
+#include "render_config.hpp"
+#include "world_mesher.hpp"
 #include <core/game.hpp>
 #include <opengl/texture.hpp>
 #include <opengl/vertex_buffer.hpp>
 #include <opengl/shader.hpp>
 #include <opengl/target.hpp>
+#include <opengl/command_buffer.hpp>
+#include <util/thread_pool.hpp>
+#include <util/transform_batch.hpp>
 #include <vector>
 
 class renderer_t {
 private:
+  render_config_t m_config;
+  shader_defines_t m_defines;
+  
   vertex_buffer_t m_vertex_buffer;
+  world_mesher_t m_world;
   
   lighting_t m_lighting;
   camera_t m_camera;
+  frame_t m_frame;
   game_t& m_game;
   
   texture_t m_depth;
@@ -34,17 +45,30 @@ private:
   shader_t m_dither;
   shader_t m_tone_map;
   
-  std::vector<mesh_t> m_meshes;
+  // the parts of each meshname_t; only imported meshes have more than one
+  std::vector<std::vector<mesh_t>> m_meshes;
   std::vector<texture_t> m_textures;
   std::vector<material_t> m_materials;
   
+  command_buffer_t m_gbuffer_commands;
+  std::vector<command_buffer_t> m_entity_commands;
+  std::vector<int> m_entity_lods;
+  transform_batch_t m_entity_transforms;
+  std::vector<mat4> m_entity_matrices;
+  command_buffer_t m_post_commands;
+  
   void init_assets();
   
+  void stream_textures();
+  void update_world();
+  void draw_world();
   void draw_entities();
-  void draw_buffer(int width, int height, shader_t& shader);
+  void record_entities(command_buffer_t& commands, entity_t begin, entity_t end);
+  int select_lod(entity_t entity, const std::vector<mesh_t>& parts, mat4 model, float max_scale);
+  bool draw_buffer(target_t* target, int width, int height, shader_t& shader);
 
 public:
-  renderer_t(game_t& game);
+  renderer_t(game_t& game, quality_t quality = QUALITY_HIGH);
   void bind();
   void render();
 };
@@ -1,16 +1,34 @@
 #include "shader_builder.hpp"
+#include <cstdio>
+#include <cstring>
+
+void shader_define(shader_defines_t& defines, const char* name, int value) {
+  defines[name] = std::to_string(value);
+}
+
+void shader_define(shader_defines_t& defines, const char* name, float value) {
+  char str[32];
+  snprintf(str, sizeof(str), "%g", value);
+  
+  // GLSL would read "100" as an int
+  if (!strpbrk(str, ".e")) {
+    strcat(str, ".0");
+  }
+  
+  defines[name] = str;
+}
 
 shader_builder_t::shader_builder_t() {
   
 }
 
 shader_builder_t& shader_builder_t::source_vertex_shader(const char* path) {
-  m_src_vertex << shader_read_source(path).rdbuf();
+  m_src_vertex += shader_read_source(path);
   return *this;
 }
 
 shader_builder_t& shader_builder_t::source_fragment_shader(const char* path) {
-  m_src_fragment << shader_read_source(path).rdbuf();
+  m_src_fragment += shader_read_source(path);
   return *this;
 }
 
@@ -24,6 +42,24 @@ shader_builder_t& shader_builder_t::bind(const char* name, int channel) {
   return *this;
 }
 
+shader_builder_t& shader_builder_t::define(const char* name, int value) {
+  shader_define(m_defines, name, value);
+  return *this;
+}
+
+shader_builder_t& shader_builder_t::define(const char* name, float value) {
+  shader_define(m_defines, name, value);
+  return *this;
+}
+
+shader_builder_t& shader_builder_t::define(const shader_defines_t& defines) {
+  for (const std::pair<const std::string, std::string>& define : defines) {
+    m_defines[define.first] = define.second;
+  }
+  
+  return *this;
+}
+
 shader_builder_t& shader_builder_t::source_frame_shader(const char* path) {
   return source_vertex_shader("assets/screen-space.vert").source_fragment_shader(path);
 }
@@ -37,15 +73,26 @@ shader_builder_t& shader_builder_t::source_deferred_shader(const char* path) {
 }
 
 shader_t shader_builder_t::compile() {
-  shader_t shader = shader_t(m_src_vertex, m_src_fragment);
+  std::string prelude;
   
-  for (shader_attachment_t& shader_attachment : m_attachments) {
-    shader_attachment.attach_shader(shader);
+  for (const std::pair<const std::string, std::string>& define : m_defines) {
+    prelude += "#define " + define.first + " " + define.second + "\n";
   }
+  
+  shader_t shader(prelude + m_src_vertex, prelude + m_src_fragment);
+  
+  std::vector<shader_attachment_ref_t> attachments = m_attachments;
+  std::vector<std::pair<const char*, int>> bindings = m_bindings;
+  
+  shader.on_ready([attachments, bindings](shader_t& shader) {
+    for (shader_attachment_t& shader_attachment : attachments) {
+      shader_attachment.attach_shader(shader);
+    }
 
-  for (std::pair<const char*, int> binding : m_bindings) {
-    shader.uniform_int(binding.first, binding.second);
-  }
+    for (std::pair<const char*, int> binding : bindings) {
+      shader.uniform_int(binding.first, binding.second);
+    }
+  });
 
   return shader;
 }
@@ -4,13 +4,21 @@
 #include "shader_attachment.hpp"
 #include <opengl/shader.hpp>
 #include <iostream>
+#include <map>
+#include <string>
+
+using shader_defines_t = std::map<std::string, std::string>;
+
+void shader_define(shader_defines_t& defines, const char* name, int value);
+void shader_define(shader_defines_t& defines, const char* name, float value);
 
 class shader_builder_t {
 private:
-  std::stringstream m_src_vertex;
-  std::stringstream m_src_fragment;
+  std::string m_src_vertex;
+  std::string m_src_fragment;
   std::vector<shader_attachment_ref_t> m_attachments;
   std::vector<std::pair<const char*, int>> m_bindings;
+  shader_defines_t m_defines;
 
 public:
   shader_builder_t();
@@ -18,6 +26,9 @@ public:
   shader_builder_t& source_fragment_shader(const char* path);
   shader_builder_t& attach(shader_attachment_t& shader_attachment);
   shader_builder_t& bind(const char* name, int channel);
+  shader_builder_t& define(const char* name, int value);
+  shader_builder_t& define(const char* name, float value);
+  shader_builder_t& define(const shader_defines_t& defines);
   shader_builder_t& source_frame_shader(const char* path);
   shader_builder_t& source_deferred_shader(const char* path);
   shader_t compile();
@@ -0,0 +1,343 @@
+#include "world_mesher.hpp"
+#include "mesh_builder.hpp"
+#include <algorithm>
+#include <cmath>
+
+// touching cuboids count as neighbours when marking chunks dirty
+static const float WORLD_EPSILON = 1e-4;
+
+static uint64_t chunk_key(int x, int y, int z) {
+  return
+    ((uint64_t) (x & 0x1fffff) << 42) |
+    ((uint64_t) (y & 0x1fffff) << 21) |
+    ((uint64_t) (z & 0x1fffff));
+}
+
+static float axis(vec3 v, int i) {
+  return i == 0 ? v.x : i == 1 ? v.y : v.z;
+}
+
+static vec3 from_axes(int d, float x, float u, float v) {
+  float c[3];
+  c[d] = x;
+  c[(d + 1) % 3] = u;
+  c[(d + 2) % 3] = v;
+  return vec3(c[0], c[1], c[2]);
+}
+
+void world_mesher_t::set(int id, vec3 a, vec3 b, int material) {
+  if (id >= (int) m_cuboids.size()) {
+    m_cuboids.resize(id + 1, { vec3(0.0), vec3(0.0), 0, false });
+  }
+  
+  cuboid_t& cuboid = m_cuboids[id];
+  vec3 lo = vec3::min(a, b);
+  vec3 hi = vec3::max(a, b);
+  
+  if (
+    cuboid.live &&
+    cuboid.material == material &&
+    memcmp(&cuboid.a, &lo, sizeof(vec3)) == 0 &&
+    memcmp(&cuboid.b, &hi, sizeof(vec3)) == 0
+  ) {
+    return;
+  }
+  
+  if (cuboid.live) mark(cuboid.a, cuboid.b);
+  
+  cuboid = { lo, hi, material, true };
+  mark(lo, hi);
+}
+
+void world_mesher_t::remove(int id) {
+  if (!contains(id)) return;
+  
+  mark(m_cuboids[id].a, m_cuboids[id].b);
+  m_cuboids[id].live = false;
+}
+
+bool world_mesher_t::contains(int id) const {
+  return id >= 0 && id < (int) m_cuboids.size() && m_cuboids[id].live;
+}
+
+void world_mesher_t::mark(vec3 a, vec3 b) {
+  int lo[3], hi[3];
+  
+  for (int i = 0; i < 3; i++) {
+    lo[i] = (int) floorf((axis(a, i) - WORLD_EPSILON) / WORLD_CHUNK_SIZE);
+    hi[i] = (int) floorf((axis(b, i) + WORLD_EPSILON) / WORLD_CHUNK_SIZE);
+  }
+  
+  for (int x = lo[0]; x <= hi[0]; x++) {
+    for (int y = lo[1]; y <= hi[1]; y++) {
+      for (int z = lo[2]; z <= hi[2]; z++) {
+        chunk_t& chunk = m_chunks[chunk_key(x, y, z)];
+        chunk.x = x;
+        chunk.y = y;
+        chunk.z = z;
+        chunk.dirty = true;
+      }
+    }
+  }
+}
+
+// For each axis and facing, every plane holding a cuboid face is cut into a
+// grid along all face and occluder edges on it (coordinate compression).
+// A cell is visible if some face covers it and no cuboid fills the space just
+// in front of it. Visible cells are then greedily merged per material.
+void world_mesher_t::mesh_chunk(vec3 chunk_min, vec3 chunk_max, std::vector<world_quad_t>& quads) const {
+  class rect_t {
+  public:
+    float u0, v0, u1, v1;
+    int material;
+  };
+  
+  static thread_local std::vector<int> nearby;
+  nearby.clear();
+  
+  for (int id = 0; id < (int) m_cuboids.size(); id++) {
+    const cuboid_t& cuboid = m_cuboids[id];
+    if (!cuboid.live) continue;
+    
+    bool overlaps = true;
+    for (int i = 0; i < 3; i++) {
+      if (axis(cuboid.b, i) < axis(chunk_min, i) || axis(cuboid.a, i) > axis(chunk_max, i)) overlaps = false;
+    }
+    
+    if (overlaps) nearby.push_back(id);
+  }
+  
+  static thread_local std::vector<float> planes;
+  static thread_local std::vector<rect_t> faces;
+  static thread_local std::vector<rect_t> occluders;
+  static thread_local std::vector<float> us, vs;
+  static thread_local std::vector<int> cells;
+  
+  for (int d = 0; d < 3; d++) {
+    int du = (d + 1) % 3;
+    int dv = (d + 2) % 3;
+    
+    float clip_u0 = axis(chunk_min, du), clip_u1 = axis(chunk_max, du);
+    float clip_v0 = axis(chunk_min, dv), clip_v1 = axis(chunk_max, dv);
+    
+    for (int sign = -1; sign <= 1; sign += 2) {
+      planes.clear();
+      
+      for (int id : nearby) {
+        const cuboid_t& cuboid = m_cuboids[id];
+        float x = sign > 0 ? axis(cuboid.b, d) : axis(cuboid.a, d);
+        
+        // planes on the far chunk boundary belong to the next chunk
+        if (x >= axis(chunk_min, d) && x < axis(chunk_max, d)) planes.push_back(x);
+      }
+      
+      std::sort(planes.begin(), planes.end());
+      planes.erase(std::unique(planes.begin(), planes.end()), planes.end());
+      
+      for (float x : planes) {
+        faces.clear();
+        occluders.clear();
+        
+        for (int id : nearby) {
+          const cuboid_t& cuboid = m_cuboids[id];
+          
+          rect_t rect = {
+            std::max(clip_u0, axis(cuboid.a, du)),
+            std::max(clip_v0, axis(cuboid.a, dv)),
+            std::min(clip_u1, axis(cuboid.b, du)),
+            std::min(clip_v1, axis(cuboid.b, dv)),
+            cuboid.material
+          };
+          
+          if (rect.u0 >= rect.u1 || rect.v0 >= rect.v1) continue;
+          
+          float face = sign > 0 ? axis(cuboid.b, d) : axis(cuboid.a, d);
+          float lo = axis(cuboid.a, d);
+          float hi = axis(cuboid.b, d);
+          
+          if (face == x) {
+            faces.push_back(rect);
+          } else if (sign > 0 ? (lo <= x && hi > x) : (lo < x && hi >= x)) {
+            // solid directly in front of the plane
+            occluders.push_back(rect);
+          }
+        }
+        
+        if (faces.empty()) continue;
+        
+        us.clear();
+        vs.clear();
+        
+        for (const std::vector<rect_t>* rects : { &faces, &occluders }) {
+          for (const rect_t& rect : *rects) {
+            us.push_back(rect.u0);
+            us.push_back(rect.u1);
+            vs.push_back(rect.v0);
+            vs.push_back(rect.v1);
+          }
+        }
+        
+        std::sort(us.begin(), us.end());
+        us.erase(std::unique(us.begin(), us.end()), us.end());
+        std::sort(vs.begin(), vs.end());
+        vs.erase(std::unique(vs.begin(), vs.end()), vs.end());
+        
+        int width = (int) us.size() - 1;
+        int height = (int) vs.size() - 1;
+        cells.assign(width * height, -1);
+        
+        for (int j = 0; j < height; j++) {
+          float vc = (vs[j] + vs[j + 1]) * 0.5f;
+          
+          for (int i = 0; i < width; i++) {
+            float uc = (us[i] + us[i + 1]) * 0.5f;
+            int material = -1;
+            
+            for (const rect_t& rect : faces) {
+              if (uc > rect.u0 && uc < rect.u1 && vc > rect.v0 && vc < rect.v1) {
+                material = rect.material;
+                break;
+              }
+            }
+            
+            if (material < 0) continue;
+            
+            for (const rect_t& rect : occluders) {
+              if (uc > rect.u0 && uc < rect.u1 && vc > rect.v0 && vc < rect.v1) {
+                material = -1;
+                break;
+              }
+            }
+            
+            cells[j * width + i] = material;
+          }
+        }
+        
+        for (int j = 0; j < height; j++) {
+          for (int i = 0; i < width; i++) {
+            int material = cells[j * width + i];
+            if (material < 0) continue;
+            
+            int i1 = i + 1;
+            while (i1 < width && cells[j * width + i1] == material) i1++;
+            
+            int j1 = j + 1;
+            while (j1 < height) {
+              bool row = true;
+              for (int k = i; k < i1 && row; k++) {
+                row = cells[j1 * width + k] == material;
+              }
+              if (!row) break;
+              j1++;
+            }
+            
+            for (int y = j; y < j1; y++) {
+              for (int k = i; k < i1; k++) {
+                cells[y * width + k] = -1;
+              }
+            }
+            
+            quads.push_back({
+              from_axes(d, x, us[i], vs[j]),
+              from_axes(d, x, us[i1], vs[j1]),
+              d,
+              sign,
+              material
+            });
+          }
+        }
+      }
+    }
+  }
+}
+
+void world_mesher_t::build(chunk_t& chunk, vertex_buffer_t& vertex_buffer) {
+  for (world_mesh_t& world_mesh : chunk.meshes) {
+    vertex_buffer.free(world_mesh.mesh);
+  }
+  
+  chunk.meshes.clear();
+  chunk.dirty = false;
+  
+  vec3 chunk_min = vec3(chunk.x, chunk.y, chunk.z) * WORLD_CHUNK_SIZE;
+  vec3 chunk_max = chunk_min + vec3(WORLD_CHUNK_SIZE);
+  
+  std::vector<world_quad_t>& quads = m_quads;
+  quads.clear();
+  mesh_chunk(chunk_min, chunk_max, quads);
+  
+  std::sort(quads.begin(), quads.end(), [](const world_quad_t& a, const world_quad_t& b) {
+    return a.material < b.material;
+  });
+  
+  for (unsigned int begin = 0; begin < quads.size(); ) {
+    unsigned int end = begin;
+    while (end < quads.size() && quads[end].material == quads[begin].material) end++;
+    
+    // world quads are already minimal, so lods would only add memory
+    mesh_builder_t& mesh_builder = m_builder;
+    mesh_builder.reset();
+    mesh_builder.set_max_lods(1);
+    
+    for (unsigned int q = begin; q < end; q++) {
+      const world_quad_t& quad = quads[q];
+      int d = quad.normal_axis;
+      int du = (d + 1) % 3;
+      int dv = (d + 2) % 3;
+      float x = axis(quad.a, d);
+      
+      float u0 = axis(quad.a, du), u1 = axis(quad.b, du);
+      float v0 = axis(quad.a, dv), v1 = axis(quad.b, dv);
+      
+      // uv follows world position with a right-handed tangent frame
+      float flip = (float) quad.normal_sign;
+      vec3 normal = from_axes(d, flip, 0, 0);
+      
+      vertex_t corners[4] = {
+        vertex_t(from_axes(d, x, u0, v0), normal, vec2(u0, v0 * flip)),
+        vertex_t(from_axes(d, x, u1, v0), normal, vec2(u1, v0 * flip)),
+        vertex_t(from_axes(d, x, u1, v1), normal, vec2(u1, v1 * flip)),
+        vertex_t(from_axes(d, x, u0, v1), normal, vec2(u0, v1 * flip))
+      };
+      
+      // counter-clockwise seen from the side the quad faces
+      static constexpr int front[6] = { 0, 1, 2, 0, 2, 3 };
+      static constexpr int back[6] = { 0, 2, 1, 0, 3, 2 };
+      const int* order = quad.normal_sign > 0 ? front : back;
+      
+      for (int k = 0; k < 6; k++) {
+        mesh_builder.push_vertex(corners[order[k]]);
+      }
+    }
+    
+    mesh_builder.compile(m_mesh_data);
+    chunk.meshes.push_back({ quads[begin].material, vertex_buffer.push(m_mesh_data) });
+    begin = end;
+  }
+}
+
+// Rebuilds dirty chunks and returns how many were rebuilt.
+int world_mesher_t::update(vertex_buffer_t& vertex_buffer) {
+  int rebuilt = 0;
+  
+  for (auto& [key, chunk] : m_chunks) {
+    if (chunk.dirty) {
+      build(chunk, vertex_buffer);
+      rebuilt++;
+    }
+  }
+  
+  if (rebuilt > 0) {
+    m_meshes.clear();
+    
+    for (auto& [key, chunk] : m_chunks) {
+      m_meshes.insert(m_meshes.end(), chunk.meshes.begin(), chunk.meshes.end());
+    }
+  }
+  
+  return rebuilt;
+}
+
+const std::vector<world_mesh_t>& world_mesher_t::get_meshes() const {
+  return m_meshes;
+}
@@ -0,0 +1,73 @@
+#ifndef WORLD_MESHER_H
+#define WORLD_MESHER_H
+
+#include <opengl/vertex_buffer.hpp>
+#include <renderer/mesh_builder.hpp>
+#include <util/math3d.hpp>
+#include <unordered_map>
+#include <vector>
+
+static const float WORLD_CHUNK_SIZE = 32.0;
+
+class world_mesh_t {
+public:
+  int material;
+  mesh_t mesh;
+};
+
+// One merged quad of the world surface. a and b are opposite corners on the
+// plane, normal_axis and normal_sign give the side it faces.
+class world_quad_t {
+public:
+  vec3 a;
+  vec3 b;
+  int normal_axis;
+  int normal_sign;
+  int material;
+};
+
+// Turns a set of axis-aligned cuboids into chunked meshes. Faces that touch
+// or lie inside another cuboid are dropped and the rest are greedily merged
+// into the largest same-material quads. Changing a cuboid only rebuilds the
+// chunks it overlaps. The surface shaders derive uvs from world position, so
+// merged quads texture the same as the separate faces did.
+class world_mesher_t {
+private:
+  class cuboid_t {
+  public:
+    vec3 a;
+    vec3 b;
+    int material;
+    bool live;
+  };
+  
+  class chunk_t {
+  public:
+    int x, y, z;
+    bool dirty;
+    std::vector<world_mesh_t> meshes;
+  };
+  
+  std::vector<cuboid_t> m_cuboids;
+  std::unordered_map<uint64_t, chunk_t> m_chunks;
+  std::vector<world_mesh_t> m_meshes;
+  
+  // reused across rebuilds so editing the world does not allocate
+  std::vector<world_quad_t> m_quads;
+  mesh_builder_t m_builder;
+  mesh_data_t m_mesh_data;
+  
+  void mark(vec3 a, vec3 b);
+  void build(chunk_t& chunk, vertex_buffer_t& vertex_buffer);
+  
+public:
+  void set(int id, vec3 a, vec3 b, int material);
+  void remove(int id);
+  bool contains(int id) const;
+  
+  void mesh_chunk(vec3 chunk_min, vec3 chunk_max, std::vector<world_quad_t>& quads) const;
+  int update(vertex_buffer_t& vertex_buffer);
+  const std::vector<world_mesh_t>& get_meshes() const;
+};
+
+#endif
@@ -0,0 +1,334 @@
+#include "etc.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+// selector 0 is +small, 1 is +large, 2 is -small, 3 is -large
+static const int ETC_MODIFIERS[8][2] = {
+  { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+  { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+};
+
+static const int EAC_MODIFIERS[16][8] = {
+  { -3, -6, -9, -15, 2, 5, 8, 14 },
+  { -3, -7, -10, -13, 2, 6, 9, 12 },
+  { -2, -5, -8, -13, 1, 4, 7, 12 },
+  { -2, -4, -6, -13, 1, 3, 5, 12 },
+  { -3, -6, -8, -12, 2, 5, 7, 11 },
+  { -3, -7, -9, -11, 2, 6, 8, 10 },
+  { -4, -7, -8, -11, 3, 6, 7, 10 },
+  { -3, -5, -8, -11, 2, 4, 7, 10 },
+  { -2, -6, -8, -10, 1, 5, 7, 9 },
+  { -2, -5, -8, -10, 1, 4, 7, 9 },
+  { -2, -4, -8, -10, 1, 3, 7, 9 },
+  { -2, -5, -7, -10, 1, 4, 6, 9 },
+  { -3, -4, -7, -10, 2, 3, 6, 9 },
+  { -1, -2, -3, -10, 0, 1, 2, 9 },
+  { -4, -6, -8, -9, 3, 5, 7, 8 },
+  { -3, -5, -7, -9, 2, 4, 6, 8 }
+};
+
+static int clamp(int x, int lo, int hi) {
+  return x < lo ? lo : (x > hi ? hi : x);
+}
+
+static int square(int x) {
+  return x * x;
+}
+
+static void write_block(uint64_t bits, unsigned char* block) {
+  for (int i = 0; i < 8; i++) {
+    block[i] = (unsigned char) (bits >> (56 - 8 * i));
+  }
+}
+
+class etc_half_t {
+public:
+  int error;
+  int table;
+  uint64_t selectors;
+};
+
+// Picks the modifier table and per-texel selectors for one half of the block
+// around an already quantised base colour. Selector bits are placed where
+// the block stores them, texel (x, y) at bit x * 4 + y and its msb 16 above.
+static etc_half_t etc_fit_half(const unsigned char* texels, const int* pixels, const int* base) {
+  etc_half_t best = { INT_MAX, 0, 0 };
+  
+  for (int table = 0; table < 8; table++) {
+    int error = 0;
+    uint64_t selectors = 0;
+    
+    for (int i = 0; i < 8; i++) {
+      const unsigned char* texel = &texels[pixels[i] * 4];
+      int best_selector = 0;
+      int best_error = INT_MAX;
+      
+      for (int selector = 0; selector < 4; selector++) {
+        int modifier = ETC_MODIFIERS[table][selector & 1];
+        if (selector & 2) modifier = -modifier;
+        
+        int e =
+          square(clamp(base[0] + modifier, 0, 255) - texel[0]) +
+          square(clamp(base[1] + modifier, 0, 255) - texel[1]) +
+          square(clamp(base[2] + modifier, 0, 255) - texel[2]);
+        
+        if (e < best_error) {
+          best_error = e;
+          best_selector = selector;
+        }
+      }
+      
+      int x = pixels[i] % 4, y = pixels[i] / 4;
+      int bit = x * 4 + y;
+      selectors |= (uint64_t) (best_selector & 1) << bit;
+      selectors |= (uint64_t) (best_selector >> 1) << (bit + 16);
+      error += best_error;
+      
+      if (error >= best.error) break;
+    }
+    
+    if (error < best.error) {
+      best = { error, table, selectors };
+    }
+  }
+  
+  return best;
+}
+
+static int etc_encode_etc1(const unsigned char* texels, uint64_t& bits) {
+  int best_error = INT_MAX;
+  
+  for (int flip = 0; flip < 2; flip++) {
+    int pixels[2][8];
+    float average[2][3] = {};
+    
+    for (int half = 0; half < 2; half++) {
+      for (int i = 0; i < 8; i++) {
+        // flipped halves are the top and bottom 4x2, otherwise left and right 2x4
+        int x = flip ? i % 4 : half * 2 + i % 2;
+        int y = flip ? half * 2 + i / 4 : i / 2;
+        pixels[half][i] = y * 4 + x;
+        
+        for (int c = 0; c < 3; c++) {
+          average[half][c] += texels[(y * 4 + x) * 4 + c] / 8.0f;
+        }
+      }
+    }
+    
+    // individual mode, two 4-bit colours
+    {
+      int q[2][3], base[2][3];
+      
+      for (int half = 0; half < 2; half++) {
+        for (int c = 0; c < 3; c++) {
+          q[half][c] = clamp((int) std::lround(average[half][c] * 15.0f / 255.0f), 0, 15);
+          base[half][c] = q[half][c] * 17;
+        }
+      }
+      
+      etc_half_t a = etc_fit_half(texels, pixels[0], base[0]);
+      etc_half_t b = etc_fit_half(texels, pixels[1], base[1]);
+      
+      if (a.error + b.error < best_error) {
+        best_error = a.error + b.error;
+        bits =
+          (uint64_t) q[0][0] << 60 | (uint64_t) q[1][0] << 56 |
+          (uint64_t) q[0][1] << 52 | (uint64_t) q[1][1] << 48 |
+          (uint64_t) q[0][2] << 44 | (uint64_t) q[1][2] << 40 |
+          (uint64_t) a.table << 37 | (uint64_t) b.table << 34 |
+          (uint64_t) flip << 32 |
+          a.selectors | b.selectors;
+      }
+    }
+    
+    // differential mode, a 5-bit colour and a 3-bit signed delta to the second
+    {
+      int q[3], delta[3], base[2][3];
+      
+      for (int c = 0; c < 3; c++) {
+        q[c] = clamp((int) std::lround(average[0][c] * 31.0f / 255.0f), 0, 31);
+        int q1 = clamp((int) std::lround(average[1][c] * 31.0f / 255.0f), 0, 31);
+        delta[c] = clamp(q1 - q[c], -4, 3);
+        q1 = clamp(q[c] + delta[c], 0, 31);
+        delta[c] = q1 - q[c];
+        
+        base[0][c] = (q[c] << 3) | (q[c] >> 2);
+        base[1][c] = (q1 << 3) | (q1 >> 2);
+      }
+      
+      etc_half_t a = etc_fit_half(texels, pixels[0], base[0]);
+      etc_half_t b = etc_fit_half(texels, pixels[1], base[1]);
+      
+      if (a.error + b.error < best_error) {
+        best_error = a.error + b.error;
+        bits =
+          (uint64_t) q[0] << 59 | (uint64_t) (delta[0] & 7) << 56 |
+          (uint64_t) q[1] << 51 | (uint64_t) (delta[1] & 7) << 48 |
+          (uint64_t) q[2] << 43 | (uint64_t) (delta[2] & 7) << 40 |
+          (uint64_t) a.table << 37 | (uint64_t) b.table << 34 |
+          (uint64_t) 1 << 33 | (uint64_t) flip << 32 |
+          a.selectors | b.selectors;
+      }
+    }
+  }
+  
+  return best_error;
+}
+
+static int sign_extend3(int x) {
+  return x >= 4 ? x - 8 : x;
+}
+
+// Planar blocks are signalled by the blue channel of the differential mode
+// overflowing while red and green do not. The bits that decide this are not
+// part of any colour, so the first assignment that satisfies it is used.
+static uint64_t etc_planar_mode_bits(uint64_t bits) {
+  static const int FREE_BITS[6] = { 63, 55, 47, 46, 45, 42 };
+  
+  for (int mask = 0; mask < 64; mask++) {
+    uint64_t candidate = bits;
+    
+    for (int i = 0; i < 6; i++) {
+      if (mask & (1 << i)) candidate |= (uint64_t) 1 << FREE_BITS[i];
+    }
+    
+    int r = (int) (candidate >> 59) & 31, dr = sign_extend3((int) (candidate >> 56) & 7);
+    int g = (int) (candidate >> 51) & 31, dg = sign_extend3((int) (candidate >> 48) & 7);
+    int b = (int) (candidate >> 43) & 31, db = sign_extend3((int) (candidate >> 40) & 7);
+    
+    if (r + dr >= 0 && r + dr <= 31 && g + dg >= 0 && g + dg <= 31 && (b + db < 0 || b + db > 31)) {
+      return candidate;
+    }
+  }
+  
+  throw std::logic_error("no planar mode encoding");
+}
+
+// Least squares fit of a plane through each channel, stored as its values at
+// the origin (O) and at x = 4 (H) and y = 4 (V).
+static int etc_encode_planar(const unsigned char* texels, uint64_t& bits) {
+  static const int BITS[3] = { 6, 7, 6 };
+  int q[3][3];
+  int e[3][3];
+  
+  for (int c = 0; c < 3; c++) {
+    float mean = 0, slope_x = 0, slope_y = 0;
+    
+    for (int y = 0; y < 4; y++) {
+      for (int x = 0; x < 4; x++) {
+        float value = texels[(y * 4 + x) * 4 + c];
+        mean += value / 16.0f;
+        slope_x += (x - 1.5f) * value / 20.0f;
+        slope_y += (y - 1.5f) * value / 20.0f;
+      }
+    }
+    
+    float origin = mean - 1.5f * slope_x - 1.5f * slope_y;
+    float values[3] = { origin, origin + 4.0f * slope_x, origin + 4.0f * slope_y };
+    int max = (1 << BITS[c]) - 1;
+    
+    for (int k = 0; k < 3; k++) {
+      q[k][c] = clamp((int) std::lround(values[k] * max / 255.0f), 0, max);
+      e[k][c] = BITS[c] == 6 ? (q[k][c] << 2) | (q[k][c] >> 4) : (q[k][c] << 1) | (q[k][c] >> 6);
+    }
+  }
+  
+  int error = 0;
+  
+  for (int y = 0; y < 4; y++) {
+    for (int x = 0; x < 4; x++) {
+      for (int c = 0; c < 3; c++) {
+        int value = clamp((x * (e[1][c] - e[0][c]) + y * (e[2][c] - e[0][c]) + 4 * e[0][c] + 2) >> 2, 0, 255);
+        error += square(value - texels[(y * 4 + x) * 4 + c]);
+      }
+    }
+  }
+  
+  int ro = q[0][0], go = q[0][1], bo = q[0][2];
+  int rh = q[1][0], gh = q[1][1], bh = q[1][2];
+  int rv = q[2][0], gv = q[2][1], bv = q[2][2];
+  
+  bits = etc_planar_mode_bits(
+    (uint64_t) ro << 57 |
+    (uint64_t) (go >> 6) << 56 | (uint64_t) (go & 63) << 49 |
+    (uint64_t) (bo >> 5) << 48 | (uint64_t) ((bo >> 3) & 3) << 43 |
+    (uint64_t) ((bo >> 1) & 3) << 40 | (uint64_t) (bo & 1) << 39 |
+    (uint64_t) (rh >> 1) << 34 | (uint64_t) 1 << 33 | (uint64_t) (rh & 1) << 32 |
+    (uint64_t) gh << 25 | (uint64_t) bh << 19 |
+    (uint64_t) rv << 13 | (uint64_t) gv << 6 | (uint64_t) bv
+  );
+  
+  return error;
+}
+
+void etc2_encode_rgb(const unsigned char* texels, unsigned char* block) {
+  uint64_t etc1_bits = 0, planar_bits = 0;
+  int etc1_error = etc_encode_etc1(texels, etc1_bits);
+  int planar_error = etc_encode_planar(texels, planar_bits);
+  
+  write_block(planar_error < etc1_error ? planar_bits : etc1_bits, block);
+}
+
+// Decoded values are base * 8 + 4 + modifier * multiplier * 8 in 11 bits.
+// Per table the multiplier is chosen to cover the block's range and the base
+// to centre the table on it.
+void eac_encode_r11(const unsigned char* texels, int channel, unsigned char* block) {
+  int target[16];
+  int lo = INT_MAX, hi = INT_MIN;
+  
+  for (int i = 0; i < 16; i++) {
+    target[i] = (texels[i * 4 + channel] * 2047 + 127) / 255;
+    lo = std::min(lo, target[i]);
+    hi = std::max(hi, target[i]);
+  }
+  
+  int best_error = INT_MAX;
+  uint64_t best_bits = 0;
+  
+  for (int table = 0; table < 16; table++) {
+    const int* modifiers = EAC_MODIFIERS[table];
+    int span = (modifiers[7] - modifiers[3]) * 8;
+    int multiplier_guess = (hi - lo) / span;
+    
+    for (int multiplier = multiplier_guess; multiplier <= multiplier_guess + 1; multiplier++) {
+      int m = clamp(multiplier, 1, 15);
+      int centre = (lo + hi) / 2 - 4 - (modifiers[3] + modifiers[7]) * m * 4;
+      int base = clamp((centre + 4) / 8, 0, 255);
+      
+      int error = 0;
+      uint64_t indices = 0;
+      
+      for (int i = 0; i < 16; i++) {
+        int best_index = 0;
+        int best_pixel_error = INT_MAX;
+        
+        for (int index = 0; index < 8; index++) {
+          int value = clamp(base * 8 + 4 + modifiers[index] * m * 8, 0, 2047);
+          int e = square(value - target[i]);
+          
+          if (e < best_pixel_error) {
+            best_pixel_error = e;
+            best_index = index;
+          }
+        }
+        
+        // texel (x, y) is the (x * 4 + y)th index from the top
+        int x = i % 4, y = i / 4;
+        indices |= (uint64_t) best_index << (45 - 3 * (x * 4 + y));
+        error += best_pixel_error;
+        
+        if (error >= best_error) break;
+      }
+      
+      if (error < best_error) {
+        best_error = error;
+        best_bits = (uint64_t) base << 56 | (uint64_t) m << 52 | (uint64_t) table << 48 | indices;
+      }
+    }
+  }
+  
+  write_block(best_bits, block);
+}
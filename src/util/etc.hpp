@@ -0,0 +1,16 @@
+#ifndef ETC_H
+#define ETC_H
+
+// Block encoders for the compressed formats every GLES 3.0 device supports.
+// Both read a 4x4 block of RGBA8 texels in row-major order and write one
+// 8-byte block.
+
+// ETC2 RGB8. Tries the ETC1 individual and differential modes in both
+// orientations and the ETC2 planar mode; the T and H modes are not used.
+void etc2_encode_rgb(const unsigned char* texels, unsigned char* block);
+
+// EAC R11 of one channel. An RG11 block is the R11 block of the red channel
+// followed by the R11 block of the green channel.
+void eac_encode_r11(const unsigned char* texels, int channel, unsigned char* block);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+static const uint64_t HASH_SEED = 0xcbf29ce484222325ull;
+
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = HASH_SEED) {
+  const unsigned char* bytes = (const unsigned char*) data;
+  
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  
+  return hash;
+}
+
+inline uint64_t hash_string(const std::string& str, uint64_t hash = HASH_SEED) {
+  // length first so ("ab", "c") and ("a", "bc") hash differently
+  uint64_t size = str.size();
+  hash = hash_bytes(&size, sizeof(size), hash);
+  return hash_bytes(str.data(), str.size(), hash);
+}
+
+#endif
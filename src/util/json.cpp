@@ -0,0 +1,229 @@
+#include "json.hpp"
+#include <charconv>
+#include <iostream>
+#include <stdexcept>
+
+class json_parser_t {
+private:
+  const char* m_begin;
+  const char* m_pos;
+  const char* m_end;
+  std::vector<json_node_t>& m_nodes;
+  
+  void fail(const char* message) {
+    std::cerr << "error: json: " << message << " at offset " << (m_pos - m_begin) << std::endl;
+    throw std::runtime_error("failed to parse json");
+  }
+  
+  void skip_space() {
+    while (m_pos < m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\n' || *m_pos == '\r')) {
+      m_pos++;
+    }
+  }
+  
+  bool accept(char c) {
+    skip_space();
+    if (m_pos < m_end && *m_pos == c) {
+      m_pos++;
+      return true;
+    }
+    return false;
+  }
+  
+  void expect(char c) {
+    if (!accept(c)) fail("unexpected character");
+  }
+  
+  void expect_word(std::string_view word) {
+    if ((size_t) (m_end - m_pos) < word.size() || std::string_view(m_pos, word.size()) != word) {
+      fail("unexpected literal");
+    }
+    m_pos += word.size();
+  }
+  
+  std::string_view parse_string() {
+    expect('"');
+    const char* begin = m_pos;
+    
+    while (m_pos < m_end && *m_pos != '"') {
+      if (*m_pos == '\\') m_pos++;
+      m_pos++;
+    }
+    
+    if (m_pos >= m_end) fail("unterminated string");
+    
+    std::string_view text(begin, m_pos - begin);
+    m_pos++;
+    return text;
+  }
+  
+  int push(json_type_t type) {
+    json_node_t node;
+    node.type = type;
+    node.number = 0.0;
+    node.size = 0;
+    node.first_child = -1;
+    node.next_sibling = -1;
+    m_nodes.push_back(node);
+    return (int) m_nodes.size() - 1;
+  }
+  
+  // children are linked in order through next_sibling
+  void link(int parent, int& last, int child) {
+    if (last < 0) m_nodes[parent].first_child = child;
+    else m_nodes[last].next_sibling = child;
+    m_nodes[parent].size++;
+    last = child;
+  }
+
+public:
+  json_parser_t(const char* text, size_t size, std::vector<json_node_t>& nodes)
+    : m_begin(text), m_pos(text), m_end(text + size), m_nodes(nodes) {}
+  
+  int parse_value(int depth) {
+    if (depth > 256) fail("nesting too deep");
+    
+    skip_space();
+    if (m_pos >= m_end) fail("unexpected end of input");
+    
+    char c = *m_pos;
+    
+    if (c == '{') {
+      m_pos++;
+      int node = push(JSON_OBJECT);
+      int last = -1;
+      
+      if (!accept('}')) {
+        do {
+          skip_space();
+          std::string_view key = parse_string();
+          expect(':');
+          int child = parse_value(depth + 1);
+          m_nodes[child].key = key;
+          link(node, last, child);
+        } while (accept(','));
+        
+        expect('}');
+      }
+      
+      return node;
+    }
+    
+    if (c == '[') {
+      m_pos++;
+      int node = push(JSON_ARRAY);
+      int last = -1;
+      
+      if (!accept(']')) {
+        do {
+          int child = parse_value(depth + 1);
+          link(node, last, child);
+        } while (accept(','));
+        
+        expect(']');
+      }
+      
+      return node;
+    }
+    
+    if (c == '"') {
+      std::string_view text = parse_string();
+      int node = push(JSON_STRING);
+      m_nodes[node].text = text;
+      return node;
+    }
+    
+    if (c == 't' || c == 'f') {
+      bool value = c == 't';
+      expect_word(value ? "true" : "false");
+      int node = push(JSON_BOOL);
+      m_nodes[node].number = value;
+      return node;
+    }
+    
+    if (c == 'n') {
+      expect_word("null");
+      return push(JSON_NULL);
+    }
+    
+    double number;
+    std::from_chars_result result = std::from_chars(m_pos, m_end, number);
+    if (result.ec != std::errc()) fail("invalid number");
+    
+    m_pos = result.ptr;
+    int node = push(JSON_NUMBER);
+    m_nodes[node].number = number;
+    return node;
+  }
+  
+  void finish() {
+    skip_space();
+    if (m_pos != m_end) fail("trailing characters");
+  }
+};
+
+json_document_t::json_document_t(const char* text, size_t size) {
+  json_parser_t parser(text, size, m_nodes);
+  parser.parse_value(0);
+  parser.finish();
+}
+
+json_value_t json_document_t::root() const {
+  return json_value_t(this, 0);
+}
+
+json_value_t::json_value_t(const json_document_t* document, int node) {
+  m_document = document;
+  m_node = node;
+}
+
+bool json_value_t::is_valid() const {
+  return m_node >= 0;
+}
+
+json_type_t json_value_t::get_type() const {
+  return m_node >= 0 ? m_document->m_nodes[m_node].type : JSON_INVALID;
+}
+
+int json_value_t::size() const {
+  return m_node >= 0 ? m_document->m_nodes[m_node].size : 0;
+}
+
+json_value_t json_value_t::get(std::string_view key) const {
+  if (get_type() != JSON_OBJECT) return json_value_t(m_document, -1);
+  
+  for (int child = m_document->m_nodes[m_node].first_child; child >= 0; child = m_document->m_nodes[child].next_sibling) {
+    if (m_document->m_nodes[child].key == key) {
+      return json_value_t(m_document, child);
+    }
+  }
+  
+  return json_value_t(m_document, -1);
+}
+
+json_value_t json_value_t::at(int index) const {
+  if (index < 0 || (get_type() != JSON_ARRAY && get_type() != JSON_OBJECT)) return json_value_t(m_document, -1);
+  
+  int child = m_document->m_nodes[m_node].first_child;
+  while (child >= 0 && index-- > 0) {
+    child = m_document->m_nodes[child].next_sibling;
+  }
+  
+  return json_value_t(m_document, child);
+}
+
+double json_value_t::as_number(double fallback) const {
+  return get_type() == JSON_NUMBER ? m_document->m_nodes[m_node].number : fallback;
+}
+
+int json_value_t::as_int(int fallback) const {
+  return get_type() == JSON_NUMBER ? (int) m_document->m_nodes[m_node].number : fallback;
+}
+
+bool json_value_t::as_bool(bool fallback) const {
+  return get_type() == JSON_BOOL ? m_document->m_nodes[m_node].number != 0.0 : fallback;
+}
+
+std::string_view json_value_t::as_string(std::string_view fallback) const {
+  return get_type() == JSON_STRING ? m_document->m_nodes[m_node].text : fallback;
+}
@@ -0,0 +1,65 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <string_view>
+#include <vector>
+
+enum json_type_t {
+  JSON_INVALID,
+  JSON_NULL,
+  JSON_BOOL,
+  JSON_NUMBER,
+  JSON_STRING,
+  JSON_ARRAY,
+  JSON_OBJECT
+};
+
+class json_node_t {
+public:
+  json_type_t type;
+  std::string_view key;
+  std::string_view text;
+  double number;
+  int size;
+  int first_child;
+  int next_sibling;
+};
+
+class json_document_t;
+
+// Handle to a node in a json_document_t. Lookups on a missing key or index
+// return an invalid value instead of throwing, so optional fields read as
+// their fallbacks.
+class json_value_t {
+private:
+  const json_document_t* m_document;
+  int m_node;
+  
+public:
+  json_value_t(const json_document_t* document, int node);
+  
+  bool is_valid() const;
+  json_type_t get_type() const;
+  int size() const;
+  json_value_t get(std::string_view key) const;
+  json_value_t at(int index) const;
+  double as_number(double fallback = 0.0) const;
+  int as_int(int fallback = 0) const;
+  bool as_bool(bool fallback = false) const;
+  std::string_view as_string(std::string_view fallback = "") const;
+};
+
+// Parses a whole document into a flat node array. Strings are views into the
+// source text with escapes left as-is, so the text must outlive the document.
+class json_document_t {
+private:
+  std::vector<json_node_t> m_nodes;
+  
+  friend class json_value_t;
+  
+public:
+  json_document_t(const char* text, size_t size);
+  json_value_t root() const;
+};
+
+#endif
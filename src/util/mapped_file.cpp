@@ -0,0 +1,56 @@
+#include "mapped_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <stdexcept>
+
+mapped_file_t::mapped_file_t(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  
+  if (fd < 0) {
+    std::cerr << "error: could not open " << path << std::endl;
+    throw std::runtime_error("failed to open file");
+  }
+  
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    close(fd);
+    std::cerr << "error: could not stat " << path << std::endl;
+    throw std::runtime_error("failed to stat file");
+  }
+  
+  m_size = info.st_size;
+  m_data = nullptr;
+  
+  // mmap rejects zero-length mappings
+  if (m_size > 0) {
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    
+    if (data == MAP_FAILED) {
+      close(fd);
+      std::cerr << "error: could not map " << path << std::endl;
+      throw std::runtime_error("failed to map file");
+    }
+    
+    madvise(data, m_size, MADV_WILLNEED);
+    m_data = (const char*) data;
+  }
+  
+  close(fd);
+}
+
+mapped_file_t::~mapped_file_t() {
+  if (m_data) {
+    munmap((void*) m_data, m_size);
+  }
+}
+
+const char* mapped_file_t::data() const {
+  return m_data;
+}
+
+size_t mapped_file_t::size() const {
+  return m_size;
+}
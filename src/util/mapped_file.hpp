@@ -0,0 +1,24 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are faulted in by the
+// kernel as they are touched, so large assets never get copied into the heap.
+class mapped_file_t {
+private:
+  const char* m_data;
+  size_t m_size;
+  
+public:
+  mapped_file_t(const std::string& path);
+  mapped_file_t(const mapped_file_t&) = delete;
+  mapped_file_t& operator=(const mapped_file_t&) = delete;
+  ~mapped_file_t();
+  
+  const char* data() const;
+  size_t size() const;
+};
+
+#endif
@@ -4,40 +4,80 @@
 #include <ostream>
 #include <cmath>
 
+// vec4 and mat4 use SSE2 or NEON where the target has it. vec3 stays a plain
+// 12-byte struct since vertex formats and hashed keys rely on its layout.
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MATH3D_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MATH3D_NEON
+#endif
+
+// Constructors, arithmetic and the fixed transforms are constexpr so constant
+// geometry folds at compile time. The SIMD paths are skipped while folding.
+#if defined(__GNUC__) || defined(__clang__)
+#define MATH3D_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#else
+#define MATH3D_CONSTANT_EVALUATED() false
+#endif
+
+// sin and cos the compiler can evaluate: a Taylor series after reducing the
+// angle to [-pi, pi]. At run time they defer to libm.
+constexpr float const_sin(float t) {
+  if (!MATH3D_CONSTANT_EVALUATED()) return sinf(t);
+  
+  const double two_pi = 6.283185307179586;
+  double x = t;
+  long n = (long) (x / two_pi + (x >= 0 ? 0.5 : -0.5));
+  x -= n * two_pi;
+  
+  double term = x;
+  double sum = x;
+  
+  for (int i = 1; i < 12; i++) {
+    term *= -x * x / ((2 * i) * (2 * i + 1));
+    sum += term;
+  }
+  
+  return (float) sum;
+}
+
+constexpr float const_cos(float t) {
+  if (!MATH3D_CONSTANT_EVALUATED()) return cosf(t);
+  return const_sin(t + 1.5707963267948966);
+}
+
 class vec2 {
 public:
   float x, y;
   
   
-  inline vec2(float x_, float y_) {
-    x = x_;
-    y = y_;
-  }
-  
-  inline vec2(float f) : vec2(f, f) {}
-  inline vec2() : vec2(0.0) {}
+  constexpr vec2(float x_, float y_) : x(x_), y(y_) {}
+  constexpr vec2(float f) : vec2(f, f) {}
+  constexpr vec2() : vec2(0.0) {}
   
-  inline vec2 operator-() {
+  constexpr vec2 operator-() {
     return vec2(-x, -y);
   }
   
-  inline friend vec2 operator+(const vec2& a, const vec2& b) {
+  constexpr friend vec2 operator+(const vec2& a, const vec2& b) {
     return vec2(a.x + b.x, a.y + b.y);
   }
   
-  inline friend vec2 operator-(const vec2& a, const vec2& b) {
+  constexpr friend vec2 operator-(const vec2& a, const vec2& b) {
     return vec2(a.x - b.x, a.y - b.y);
   }
   
-  inline friend vec2 operator+(const vec2& a, float b) {
+  constexpr friend vec2 operator+(const vec2& a, float b) {
     return a + vec2(b, b);
   }
   
-  inline friend vec2 operator-(const vec2& a, float b) {
+  constexpr friend vec2 operator-(const vec2& a, float b) {
     return a - vec2(b, b);
   }
   
-  inline friend vec2 operator*(const vec2& a, float b) {
+  constexpr friend vec2 operator*(const vec2& a, float b) {
     return vec2(a.x * b, a.y * b);
   }
   
@@ -51,26 +91,22 @@ class vec3 {
 public:
   float x, y, z;
   
-  inline vec3(float x_, float y_, float z_) {
-      x = x_;
-    y = y_;
-    z = z_;
-  }
+  constexpr vec3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
   
-  inline vec3(vec2 xy, float z_) : vec3(xy.x, xy.y, z_) {}
-  inline vec3(float f) : vec3(f, f, f) {}
-  inline vec3() : vec3(0.0, 0.0, 0.0) {}
-  inline vec2 get_xy() { return vec2(x, y); }
+  constexpr vec3(vec2 xy, float z_) : vec3(xy.x, xy.y, z_) {}
+  constexpr vec3(float f) : vec3(f, f, f) {}
+  constexpr vec3() : vec3(0.0, 0.0, 0.0) {}
+  constexpr vec2 get_xy() const { return vec2(x, y); }
   
-  inline bool is_positive() {
+  constexpr bool is_positive() const {
     return x >= 0 && y >= 0 && z >= 0;
   }
   
-  inline bool is_negative() {
+  constexpr bool is_negative() const {
     return !is_positive();
   }
   
-  inline vec3 reduce_to_min_axis() {
+  constexpr vec3 reduce_to_min_axis() const {
     if (x < y) {
       return x < z ? vec3(x, 0, 0) : vec3(0, 0, z);
     } else {
@@ -90,47 +126,51 @@ public:
     return *this * (1.0 / length());
   }
   
-  inline static float dot(vec3 a, vec3 b) {
+  constexpr static float dot(vec3 a, vec3 b) {
     return a.x * b.x + a.y * b.y + a.z * b.z;
   }
   
-  inline static vec3 min(vec3 a, vec3 b) {
+  constexpr static vec3 cross(vec3 a, vec3 b) {
+    return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+  }
+  
+  constexpr static vec3 min(vec3 a, vec3 b) {
     return vec3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
   }
   
-  inline static vec3 max(vec3 a, vec3 b) {
+  constexpr static vec3 max(vec3 a, vec3 b) {
     return vec3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
   }
   
-  inline vec3 operator-() {
+  constexpr vec3 operator-() {
     return vec3(-x, -y, -z);
   }
   
-  inline friend vec3 operator-(const vec3& v) {
+  constexpr friend vec3 operator-(const vec3& v) {
     return vec3(-v.x, -v.y, -v.z);
   }
   
-  inline friend vec3 operator+(const vec3& v) {
+  constexpr friend vec3 operator+(const vec3& v) {
     return v;
   }
   
-  inline friend vec3 operator+(const vec3& a, const vec3& b) {
+  constexpr friend vec3 operator+(const vec3& a, const vec3& b) {
     return vec3(a.x + b.x, a.y + b.y, a.z + b.z);
   }
   
-  inline friend vec3 operator-(const vec3& a, const vec3& b) {
+  constexpr friend vec3 operator-(const vec3& a, const vec3& b) {
     return vec3(a.x - b.x, a.y - b.y, a.z - b.z);
   }
   
-  inline friend vec3 operator*(const vec3& a, float b) {
+  constexpr friend vec3 operator*(const vec3& a, float b) {
     return vec3(a.x * b, a.y * b, a.z * b);
   }
   
-  inline friend vec3& operator*=(vec3& a, float b) {
+  constexpr friend vec3& operator*=(vec3& a, float b) {
     return a = a * b;
   }
   
-  inline friend vec3& operator+=(vec3& a, const vec3& b) {
+  constexpr friend vec3& operator+=(vec3& a, const vec3& b) {
     return a = a + b;
   }
   
@@ -140,36 +180,70 @@ public:
   }
 };
 
-class vec4 {
+class alignas(16) vec4 {
 public:
   float x, y, z, w;
   
-  inline vec4(float x_, float y_, float z_, float w_) {
-    x = x_;
-    y = y_;
-    z = z_;
-    w = w_;
-  }
+  constexpr vec4(float x_, float y_, float z_, float w_) : x(x_), y(y_), z(z_), w(w_) {}
   
-  inline vec4(vec3 xyz, float w_) : vec4(xyz.x, xyz.y, xyz.z, w_) {}
-  inline vec4(vec2 xy, float z_, float w_) : vec4(xy.x, xy.y, z_, w_) {}
-  inline vec4() : vec4(0.0, 0.0, 0.0, 1.0) {}
-  inline vec2 get_xy() { return vec2(x, y); }
-  inline vec3 get_xyz() { return vec3(x, y, z); }
+  constexpr vec4(vec3 xyz, float w_) : vec4(xyz.x, xyz.y, xyz.z, w_) {}
+  constexpr vec4(vec2 xy, float z_, float w_) : vec4(xy.x, xy.y, z_, w_) {}
+  constexpr vec4() : vec4(0.0, 0.0, 0.0, 1.0) {}
+  constexpr vec2 get_xy() const { return vec2(x, y); }
+  constexpr vec3 get_xyz() const { return vec3(x, y, z); }
   
-  inline vec3 operator-() {
+  constexpr vec3 operator-() {
     return vec3(-x, -y, -z);
   }
   
-  inline friend vec4 operator+(const vec4& a, const vec4& b) {
+  constexpr friend vec4 operator+(const vec4& a, const vec4& b) {
+#if defined(MATH3D_SSE)
+    if (!MATH3D_CONSTANT_EVALUATED()) {
+      vec4 r;
+      _mm_store_ps(&r.x, _mm_add_ps(_mm_load_ps(&a.x), _mm_load_ps(&b.x)));
+      return r;
+    }
+#elif defined(MATH3D_NEON)
+    if (!MATH3D_CONSTANT_EVALUATED()) {
+      vec4 r;
+      vst1q_f32(&r.x, vaddq_f32(vld1q_f32(&a.x), vld1q_f32(&b.x)));
+      return r;
+    }
+#endif
     return vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
   }
   
-  inline friend vec4 operator-(const vec4& a, const vec4& b) {
+  constexpr friend vec4 operator-(const vec4& a, const vec4& b) {
+#if defined(MATH3D_SSE)
+    if (!MATH3D_CONSTANT_EVALUATED()) {
+      vec4 r;
+      _mm_store_ps(&r.x, _mm_sub_ps(_mm_load_ps(&a.x), _mm_load_ps(&b.x)));
+      return r;
+    }
+#elif defined(MATH3D_NEON)
+    if (!MATH3D_CONSTANT_EVALUATED()) {
+      vec4 r;
+      vst1q_f32(&r.x, vsubq_f32(vld1q_f32(&a.x), vld1q_f32(&b.x)));
+      return r;
+    }
+#endif
     return vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
   }
   
-  inline friend vec4 operator*(const vec4& a, float b) {
+  constexpr friend vec4 operator*(const vec4& a, float b) {
+#if defined(MATH3D_SSE)
+    if (!MATH3D_CONSTANT_EVALUATED()) {
+      vec4 r;
+      _mm_store_ps(&r.x, _mm_mul_ps(_mm_load_ps(&a.x), _mm_set1_ps(b)));
+      return r;
+    }
+#elif defined(MATH3D_NEON)
+    if (!MATH3D_CONSTANT_EVALUATED()) {
+      vec4 r;
+      vst1q_f32(&r.x, vmulq_n_f32(vld1q_f32(&a.x), b));
+      return r;
+    }
+#endif
     return vec4(a.x * b, a.y * b, a.z * b, a.w * b);
   }
   
@@ -179,6 +253,108 @@ public:
   }
 };
 
+// Unit quaternion rotation. As with mat4, a * b applies a first, so the
+// euler constructors compose in the same order as their mat4 namesakes.
+class quat {
+public:
+  float x, y, z, w;
+  
+  constexpr quat(float x_, float y_, float z_, float w_) : x(x_), y(y_), z(z_), w(w_) {}
+  
+  constexpr quat() : quat(0.0, 0.0, 0.0, 1.0) {}
+  
+  constexpr static quat axis_angle(vec3 axis, float t) {
+    float s = const_sin(t / 2);
+    return quat(axis.x * s, axis.y * s, axis.z * s, const_cos(t / 2));
+  }
+  
+  constexpr static quat rotate_x(float t) {
+    return axis_angle(vec3(1, 0, 0), t);
+  }
+  
+  // mat4::rotate_y turns the other way round y
+  constexpr static quat rotate_y(float t) {
+    return axis_angle(vec3(0, 1, 0), -t);
+  }
+  
+  constexpr static quat rotate_z(float t) {
+    return axis_angle(vec3(0, 0, 1), t);
+  }
+  
+  constexpr static quat rotate_xyz(vec3 rotation) {
+    return quat::rotate_x(rotation.x) * quat::rotate_y(rotation.y) * quat::rotate_z(rotation.z);
+  }
+  
+  constexpr static quat rotate_zyx(vec3 rotation) {
+    return quat::rotate_z(rotation.z) * quat::rotate_y(rotation.y) * quat::rotate_x(rotation.x);
+  }
+  
+  constexpr static float dot(quat a, quat b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+  }
+  
+  constexpr bool is_identity() const {
+    return x == 0.0f && y == 0.0f && z == 0.0f;
+  }
+  
+  constexpr quat conjugate() const {
+    return quat(-x, -y, -z, w);
+  }
+  
+  inline quat normalize() const {
+    float s = 1.0f / sqrt(dot(*this, *this));
+    return quat(x * s, y * s, z * s, w * s);
+  }
+  
+  constexpr vec3 rotate(vec3 v) const {
+    vec3 u = vec3(x, y, z);
+    vec3 t = vec3::cross(u, v) * 2.0f;
+    return v + t * w + vec3::cross(u, t);
+  }
+  
+  // Shortest-arc interpolation; nearly parallel inputs fall back to a
+  // normalized lerp where slerp loses precision.
+  inline static quat slerp(quat a, quat b, float t) {
+    float d = dot(a, b);
+    
+    if (d < 0.0f) {
+      b = quat(-b.x, -b.y, -b.z, -b.w);
+      d = -d;
+    }
+    
+    float wa = 1.0f - t;
+    float wb = t;
+    
+    if (d < 0.9995f) {
+      float theta = acos(d);
+      float inv_sin = 1.0f / sin(theta);
+      wa = sin(wa * theta) * inv_sin;
+      wb = sin(wb * theta) * inv_sin;
+    }
+    
+    return quat(
+      a.x * wa + b.x * wb,
+      a.y * wa + b.y * wb,
+      a.z * wa + b.z * wb,
+      a.w * wa + b.w * wb
+    ).normalize();
+  }
+  
+  constexpr friend quat operator*(const quat& a, const quat& b) {
+    return quat(
+      b.w * a.x + b.x * a.w + b.y * a.z - b.z * a.y,
+      b.w * a.y - b.x * a.z + b.y * a.w + b.z * a.x,
+      b.w * a.z + b.x * a.y - b.y * a.x + b.z * a.w,
+      b.w * a.w - b.x * a.x - b.y * a.y - b.z * a.z
+    );
+  }
+  
+  inline friend std::ostream& operator<<(std::ostream& stream, const quat& q) {
+    stream << "quat(" << q.x << ", " << q.y << ", " << q.z << ", " << q.w << ")";
+    return stream;
+  }
+};
+
 class mat2 {
 private:
   float m[4];
@@ -231,17 +407,17 @@ public:
 
 class mat4 {
 private:
-  float m[16];
+  alignas(16) float m[16];
 
 public:
-  inline mat4(vec4 a, vec4 b, vec4 c, vec4 d) {
-    m[ 0] = a.x;  m[ 1] = a.y;  m[ 2] = a.z;  m[ 3] = a.w;
-    m[ 4] = b.x;  m[ 5] = b.y;  m[ 6] = b.z;  m[ 7] = b.w;
-    m[ 8] = c.x;  m[ 9] = c.y;  m[10] = c.z;  m[11] = c.w;
-    m[12] = d.x;  m[13] = d.y;  m[14] = d.z;  m[15] = d.w;
-  }
-  
-  inline mat4(vec3 a, vec3 b, vec3 c) :
+  constexpr mat4(vec4 a, vec4 b, vec4 c, vec4 d) : m {
+    a.x, a.y, a.z, a.w,
+    b.x, b.y, b.z, b.w,
+    c.x, c.y, c.z, c.w,
+    d.x, d.y, d.z, d.w
+  } {}
+  
+  constexpr mat4(vec3 a, vec3 b, vec3 c) :
     mat4(
       vec4(a.x, a.y, a.z, 0),
       vec4(b.x, b.y, b.z, 0),
@@ -249,11 +425,14 @@ public:
       vec4(0, 0, 0, 1)
     ) {}
   
-  inline mat4() {
-    *this = mat4::identity();
-  }
+  constexpr mat4() : m {
+    1, 0, 0, 0,
+    0, 1, 0, 0,
+    0, 0, 1, 0,
+    0, 0, 0, 1
+  } {}
   
-  inline static mat4 translate(vec3 v) {
+  constexpr static mat4 translate(vec3 v) {
     return mat4(
       vec4(1, 0, 0, 0),
       vec4(0, 1, 0, 0),
@@ -262,7 +441,7 @@ public:
     );
   }
   
-  inline static mat4 scale(vec3 v) {
+  constexpr static mat4 scale(vec3 v) {
     return mat4(
       vec4(v.x, 0, 0, 0),
       vec4(0, v.y, 0, 0),
@@ -286,61 +465,162 @@ public:
     );
   }
   
-  static mat4 identity() {
+  constexpr static mat4 identity() {
+    return mat4();
+  }
+  
+  constexpr static mat4 rotate_x(float t) {
     return mat4(
       vec4(1, 0, 0, 0),
-      vec4(0, 1, 0, 0),
-      vec4(0, 0, 1, 0),
+      vec4(0, +const_cos(t), const_sin(t), 0),
+      vec4(0, -const_sin(t), const_cos(t), 0),
       vec4(0, 0, 0, 1)
     );
   }
   
-  static mat4 rotate_x(float t) {
+  constexpr static mat4 rotate_y(float t) {
     return mat4(
-      vec4(1, 0, 0, 0),
-      vec4(0, +cos(t), sin(t), 0),
-      vec4(0, -sin(t), cos(t), 0),
+      vec4(+const_cos(t), 0, const_sin(t), 0),
+      vec4(0, 1, 0, 0),
+      vec4(-const_sin(t), 0, const_cos(t), 0),
       vec4(0, 0, 0, 1)
     );
   }
   
-  static mat4 rotate_y(float t) {
+  constexpr static mat4 rotate_z(float t) {
     return mat4(
-      vec4(+cos(t), 0, sin(t), 0),
-      vec4(0, 1, 0, 0),
-      vec4(-sin(t), 0, cos(t), 0),
+      vec4(+const_cos(t), const_sin(t), 0, 0),
+      vec4(-const_sin(t), const_cos(t), 0, 0),
+      vec4(0, 0, 1, 0),
       vec4(0, 0, 0, 1)
     );
   }
   
-  static mat4 rotate_z(float t) {
+  constexpr static mat4 rotate(quat q) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    
     return mat4(
-      vec4(+cos(t), sin(t), 0, 0),
-      vec4(-sin(t), cos(t), 0, 0),
-      vec4(0, 0, 1, 0),
+      vec4(1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy), 0),
+      vec4(2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx), 0),
+      vec4(2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy), 0),
       vec4(0, 0, 0, 1)
     );
   }
   
-  static mat4 rotate_zyx(vec3 rotation) {
+  constexpr static mat4 rotate_zyx(vec3 rotation) {
     return mat4::rotate_z(rotation.z) * mat4::rotate_y(rotation.y) * mat4::rotate_x(rotation.x);
   }
   
-  static mat4 rotate_yzx(vec3 rotation) {
+  constexpr static mat4 rotate_yzx(vec3 rotation) {
     return mat4::rotate_y(rotation.y) * mat4::rotate_z(rotation.z) * mat4::rotate_x(rotation.x);
   }
   
-  static mat4 rotate_yxz(vec3 rotation) {
+  constexpr static mat4 rotate_yxz(vec3 rotation) {
     return mat4::rotate_y(rotation.y) * mat4::rotate_x(rotation.x) * mat4::rotate_z(rotation.z);
   }
   
-  static mat4 rotate_xyz(vec3 rotation) {
+  constexpr static mat4 rotate_xyz(vec3 rotation) {
     return mat4::rotate_x(rotation.x) * mat4::rotate_y(rotation.y) * mat4::rotate_z(rotation.z);
   }
   
-  inline friend mat4 operator*(const mat4& a, const mat4& b) {
+  // Inverse of a matrix whose last row is (0, 0, 0, 1): the 3x3 part is
+  // inverted through cross products and the translation is carried back
+  // through it. Scale and shear are handled, projections are not.
+  constexpr mat4 inverse_affine() const {
+    vec3 c0 = vec3(m[0], m[1], m[2]);
+    vec3 c1 = vec3(m[4], m[5], m[6]);
+    vec3 c2 = vec3(m[8], m[9], m[10]);
+    vec3 t = vec3(m[12], m[13], m[14]);
+    
+    vec3 r0 = vec3::cross(c1, c2);
+    vec3 r1 = vec3::cross(c2, c0);
+    vec3 r2 = vec3::cross(c0, c1);
+    
+    float inv_det = 1.0f / vec3::dot(c0, r0);
+    r0 *= inv_det;
+    r1 *= inv_det;
+    r2 *= inv_det;
+    
+    return mat4(
+      vec4(r0.x, r1.x, r2.x, 0),
+      vec4(r0.y, r1.y, r2.y, 0),
+      vec4(r0.z, r1.z, r2.z, 0),
+      vec4(-vec3::dot(r0, t), -vec3::dot(r1, t), -vec3::dot(r2, t), 1)
+    );
+  }
+  
+  // General inverse by cofactors, for projections. Affine matrices should use
+  // inverse_affine. A singular matrix gives infinities.
+  constexpr mat4 inverse() const {
+    float inv[16] = {
+      m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10],
+      -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10],
+      m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6],
+      -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6],
+      -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10],
+      m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10],
+      -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6],
+      m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6],
+      m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9],
+      -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9],
+      m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5],
+      -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5],
+      -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9],
+      m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9],
+      -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5],
+      m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5]
+    };
+    
+    float inv_det = 1.0f / (m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12]);
+    
+    return mat4(
+      vec4(inv[ 0], inv[ 1], inv[ 2], inv[ 3]) * inv_det,
+      vec4(inv[ 4], inv[ 5], inv[ 6], inv[ 7]) * inv_det,
+      vec4(inv[ 8], inv[ 9], inv[10], inv[11]) * inv_det,
+      vec4(inv[12], inv[13], inv[14], inv[15]) * inv_det
+    );
+  }
+  
+  // Column i of the result is b applied to column i of a.
+  constexpr friend mat4 operator*(const mat4& a, const mat4& b) {
     mat4 r;
     
+#if defined(MATH3D_SSE)
+    if (!MATH3D_CONSTANT_EVALUATED()) {
+      __m128 b0 = _mm_load_ps(&b.m[0]);
+      __m128 b1 = _mm_load_ps(&b.m[4]);
+      __m128 b2 = _mm_load_ps(&b.m[8]);
+      __m128 b3 = _mm_load_ps(&b.m[12]);
+      
+      for (int i = 0; i < 4; i++) {
+        __m128 c = _mm_mul_ps(b0, _mm_set1_ps(a.m[i * 4 + 0]));
+        c = _mm_add_ps(c, _mm_mul_ps(b1, _mm_set1_ps(a.m[i * 4 + 1])));
+        c = _mm_add_ps(c, _mm_mul_ps(b2, _mm_set1_ps(a.m[i * 4 + 2])));
+        c = _mm_add_ps(c, _mm_mul_ps(b3, _mm_set1_ps(a.m[i * 4 + 3])));
+        _mm_store_ps(&r.m[i * 4], c);
+      }
+      return r;
+    }
+#elif defined(MATH3D_NEON)
+    if (!MATH3D_CONSTANT_EVALUATED()) {
+      float32x4_t b0 = vld1q_f32(&b.m[0]);
+      float32x4_t b1 = vld1q_f32(&b.m[4]);
+      float32x4_t b2 = vld1q_f32(&b.m[8]);
+      float32x4_t b3 = vld1q_f32(&b.m[12]);
+      
+      for (int i = 0; i < 4; i++) {
+        float32x4_t c = vmulq_n_f32(b0, a.m[i * 4 + 0]);
+        c = vmlaq_n_f32(c, b1, a.m[i * 4 + 1]);
+        c = vmlaq_n_f32(c, b2, a.m[i * 4 + 2]);
+        c = vmlaq_n_f32(c, b3, a.m[i * 4 + 3]);
+        vst1q_f32(&r.m[i * 4], c);
+      }
+      return r;
+    }
+#endif
+    
     for (int i = 0; i < 4; i++) {
       for (int j = 0; j < 4; j++) {
         r.m[i * 4 + j] = 0.0;
@@ -354,7 +634,29 @@ public:
     return r;
   }
   
-  inline friend vec4 operator*(const mat4& m, const vec4& v) {
+  constexpr friend vec4 operator*(const mat4& m, const vec4& v) {
+#if defined(MATH3D_SSE)
+    if (!MATH3D_CONSTANT_EVALUATED()) {
+      vec4 r;
+      __m128 c = _mm_mul_ps(_mm_load_ps(&m.m[0]), _mm_set1_ps(v.x));
+      c = _mm_add_ps(c, _mm_mul_ps(_mm_load_ps(&m.m[4]), _mm_set1_ps(v.y)));
+      c = _mm_add_ps(c, _mm_mul_ps(_mm_load_ps(&m.m[8]), _mm_set1_ps(v.z)));
+      c = _mm_add_ps(c, _mm_mul_ps(_mm_load_ps(&m.m[12]), _mm_set1_ps(v.w)));
+      _mm_store_ps(&r.x, c);
+      return r;
+    }
+#elif defined(MATH3D_NEON)
+    if (!MATH3D_CONSTANT_EVALUATED()) {
+      vec4 r;
+      float32x4_t c = vmulq_n_f32(vld1q_f32(&m.m[0]), v.x);
+      c = vmlaq_n_f32(c, vld1q_f32(&m.m[4]), v.y);
+      c = vmlaq_n_f32(c, vld1q_f32(&m.m[8]), v.z);
+      c = vmlaq_n_f32(c, vld1q_f32(&m.m[12]), v.w);
+      vst1q_f32(&r.x, c);
+      return r;
+    }
+#endif
+    
     return vec4(
       m.m[ 0] * v.x + m.m[ 4] * v.y + m.m[ 8] * v.z + m.m[12] * v.w,
       m.m[ 1] * v.x + m.m[ 5] * v.y + m.m[ 9] * v.z + m.m[13] * v.w,
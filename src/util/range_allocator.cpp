@@ -0,0 +1,66 @@
+#include "range_allocator.hpp"
+
+range_allocator_t::range_allocator_t(int capacity) {
+  m_capacity = capacity;
+  m_used = 0;
+  
+  if (capacity > 0) {
+    m_free.push_back({ 0, capacity });
+  }
+}
+
+int range_allocator_t::allocate(int size) {
+  return allocate_below(size, m_capacity);
+}
+
+int range_allocator_t::allocate_below(int size, int limit) {
+  if (size <= 0) return 0;
+  
+  for (unsigned int i = 0; i < m_free.size() && m_free[i].offset < limit; i++) {
+    block_t& block = m_free[i];
+    
+    if (block.size >= size) {
+      int offset = block.offset;
+      block.offset += size;
+      block.size -= size;
+      
+      if (block.size == 0) {
+        m_free.erase(m_free.begin() + i);
+      }
+      
+      m_used += size;
+      return offset;
+    }
+  }
+  
+  return -1;
+}
+
+void range_allocator_t::free(int offset, int size) {
+  if (size <= 0) return;
+  
+  m_used -= size;
+  
+  unsigned int i = 0;
+  while (i < m_free.size() && m_free[i].offset < offset) i++;
+  
+  m_free.insert(m_free.begin() + i, { offset, size });
+  
+  if (i + 1 < m_free.size() && m_free[i].offset + m_free[i].size == m_free[i + 1].offset) {
+    m_free[i].size += m_free[i + 1].size;
+    m_free.erase(m_free.begin() + i + 1);
+  }
+  
+  if (i > 0 && m_free[i - 1].offset + m_free[i - 1].size == m_free[i].offset) {
+    m_free[i - 1].size += m_free[i].size;
+    m_free.erase(m_free.begin() + i);
+  }
+}
+
+int range_allocator_t::get_capacity() const {
+  return m_capacity;
+}
+
+int range_allocator_t::get_used() const {
+  return m_used;
+}
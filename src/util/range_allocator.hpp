@@ -0,0 +1,28 @@
+#ifndef RANGE_ALLOCATOR_H
+#define RANGE_ALLOCATOR_H
+
+#include <vector>
+
+// First-fit free list over [0, capacity). Freed ranges are merged with their
+// neighbours, so the list stays sorted and never holds adjacent blocks.
+class range_allocator_t {
+private:
+  struct block_t {
+    int offset;
+    int size;
+  };
+  
+  std::vector<block_t> m_free;
+  int m_capacity;
+  int m_used;
+
+public:
+  range_allocator_t(int capacity);
+  int allocate(int size);
+  int allocate_below(int size, int limit);
+  void free(int offset, int size);
+  int get_capacity() const;
+  int get_used() const;
+};
+
+#endif
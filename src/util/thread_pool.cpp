@@ -0,0 +1,116 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+thread_pool_t::thread_pool_t(int num_threads) {
+  m_running = true;
+  
+  for (int i = 0; i < num_threads; i++) {
+    m_threads.emplace_back(&thread_pool_t::work, this);
+  }
+}
+
+int thread_pool_t::size() const {
+  return (int) m_threads.size();
+}
+
+void thread_pool_t::enqueue(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(std::move(job));
+  }
+  
+  m_condition.notify_one();
+}
+
+void thread_pool_t::work() {
+  while (true) {
+    std::function<void()> job;
+    
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [this]() { return !m_running || !m_jobs.empty(); });
+      
+      if (!m_running && m_jobs.empty()) return;
+      
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+    
+    job();
+  }
+}
+
+void thread_pool_t::parallel_for(int count, int num_chunks, const std::function<void(int chunk, int begin, int end)>& fn) {
+  if (num_chunks < 1) num_chunks = 1;
+  
+  struct loop_t {
+    const std::function<void(int, int, int)>* fn;
+    int count;
+    int num_chunks;
+    std::atomic<int> next;
+    int done;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable condition;
+  };
+  
+  auto loop = std::make_shared<loop_t>();
+  loop->fn = &fn;
+  loop->count = count;
+  loop->num_chunks = num_chunks;
+  loop->next = 0;
+  loop->done = 0;
+  
+  // chunks are claimed from a counter, so the caller only ever helps with its own loop and
+  // never picks up an unrelated long job; helpers dequeued after the loop find nothing left
+  auto run = [loop]() {
+    int chunk;
+    
+    while ((chunk = loop->next++) < loop->num_chunks) {
+      int begin = loop->count * chunk / loop->num_chunks;
+      int end = loop->count * (chunk + 1) / loop->num_chunks;
+      std::exception_ptr error;
+      
+      try {
+        (*loop->fn)(chunk, begin, end);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      
+      std::lock_guard<std::mutex> lock(loop->mutex);
+      if (error && !loop->error) loop->error = error;
+      if (++loop->done == loop->num_chunks) loop->condition.notify_all();
+    }
+  };
+  
+  for (int i = 1; i < num_chunks; i++) {
+    enqueue(run);
+  }
+  
+  run();
+  
+  std::unique_lock<std::mutex> lock(loop->mutex);
+  loop->condition.wait(lock, [&loop]() { return loop->done == loop->num_chunks; });
+  
+  if (loop->error) std::rethrow_exception(loop->error);
+}
+
+thread_pool_t::~thread_pool_t() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running = false;
+  }
+  
+  m_condition.notify_all();
+  
+  for (std::thread& thread : m_threads) {
+    thread.join();
+  }
+}
+
+thread_pool_t& thread_pool_t::shared() {
+  static thread_pool_t thread_pool(std::max(1, (int) std::thread::hardware_concurrency() - 1));
+  return thread_pool;
+}
@@ -0,0 +1,43 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class thread_pool_t {
+private:
+  std::vector<std::thread> m_threads;
+  std::deque<std::function<void()>> m_jobs;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_running;
+  
+  void work();
+  void enqueue(std::function<void()> job);
+
+public:
+  thread_pool_t(int num_threads);
+  ~thread_pool_t();
+  
+  int size() const;
+  void parallel_for(int count, int num_chunks, const std::function<void(int chunk, int begin, int end)>& fn);
+  
+  template <typename F>
+  auto submit(F job) -> std::future<decltype(job())> {
+    using result_t = decltype(job());
+    auto task = std::make_shared<std::packaged_task<result_t()>>(std::move(job));
+    std::future<result_t> future = task->get_future();
+    enqueue([task]() { (*task)(); });
+    return future;
+  }
+  
+  static thread_pool_t& shared();
+};
+
+#endif
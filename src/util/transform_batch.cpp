@@ -0,0 +1,177 @@
+#include "transform_batch.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TRANSFORM_BATCH_AVX2
+#endif
+
+static_assert(sizeof(mat4) == 16 * sizeof(float), "mat4 must be 16 packed floats");
+
+void transform_batch_t::resize(int count) {
+  for (std::vector<float>* v : { &m_px, &m_py, &m_pz, &m_rx, &m_ry, &m_rz, &m_rw, &m_sx, &m_sy, &m_sz }) {
+    v->resize(count);
+  }
+}
+
+int transform_batch_t::size() const {
+  return (int) m_px.size();
+}
+
+void transform_batch_t::set(int i, vec3 position, quat rotation, vec3 scale) {
+  m_px[i] = position.x; m_py[i] = position.y; m_pz[i] = position.z;
+  m_rx[i] = rotation.x; m_ry[i] = rotation.y; m_rz[i] = rotation.z; m_rw[i] = rotation.w;
+  m_sx[i] = scale.x; m_sy[i] = scale.y; m_sz[i] = scale.z;
+}
+
+// mat4::rotate with each row scaled. Both paths evaluate the same terms so
+// they agree to rounding.
+static void compose(
+  float qx, float qy, float qz, float qw,
+  float px, float py, float pz, float kx, float ky, float kz,
+  float* m
+) {
+  float xx = qx * qx, yy = qy * qy, zz = qz * qz;
+  float xy = qx * qy, xz = qx * qz, yz = qy * qz;
+  float wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+  m[ 0] = kx * (1 - 2 * (yy + zz));
+  m[ 1] = ky * (2 * (xy + wz));
+  m[ 2] = kz * (2 * (xz - wy));
+  m[ 3] = 0.0f;
+  m[ 4] = kx * (2 * (xy - wz));
+  m[ 5] = ky * (1 - 2 * (xx + zz));
+  m[ 6] = kz * (2 * (yz + wx));
+  m[ 7] = 0.0f;
+  m[ 8] = kx * (2 * (xz + wy));
+  m[ 9] = ky * (2 * (yz - wx));
+  m[10] = kz * (1 - 2 * (xx + yy));
+  m[11] = 0.0f;
+  m[12] = px;
+  m[13] = py;
+  m[14] = pz;
+  m[15] = 1.0f;
+}
+
+#ifdef TRANSFORM_BATCH_AVX2
+
+__attribute__((target("avx2")))
+static void transpose8(__m256* r) {
+  __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+  __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+  __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+  __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+  __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+  __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+  __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+  __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+  __m256 u0 = _mm256_shuffle_ps(t0, t2, 0x44);
+  __m256 u1 = _mm256_shuffle_ps(t0, t2, 0xee);
+  __m256 u2 = _mm256_shuffle_ps(t1, t3, 0x44);
+  __m256 u3 = _mm256_shuffle_ps(t1, t3, 0xee);
+  __m256 u4 = _mm256_shuffle_ps(t4, t6, 0x44);
+  __m256 u5 = _mm256_shuffle_ps(t4, t6, 0xee);
+  __m256 u6 = _mm256_shuffle_ps(t5, t7, 0x44);
+  __m256 u7 = _mm256_shuffle_ps(t5, t7, 0xee);
+
+  r[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+  r[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+  r[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+  r[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+  r[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+  r[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+  r[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+  r[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+
+// Eight entities per iteration. The sixteen matrix entries are built as
+// sixteen registers of eight lanes and transposed in two 8x8 blocks, so
+// each entity's matrix is written with two unaligned stores.
+__attribute__((target("avx2")))
+static int compute_avx2(
+  const float* px, const float* py, const float* pz,
+  const float* rx, const float* ry, const float* rz, const float* rw,
+  const float* kx, const float* ky, const float* kz,
+  int begin, int end, float* out
+) {
+  int i = begin;
+
+  for (; i + 8 <= end; i += 8) {
+    __m256 qx = _mm256_loadu_ps(rx + i);
+    __m256 qy = _mm256_loadu_ps(ry + i);
+    __m256 qz = _mm256_loadu_ps(rz + i);
+    __m256 qw = _mm256_loadu_ps(rw + i);
+
+    __m256 vkx = _mm256_loadu_ps(kx + i);
+    __m256 vky = _mm256_loadu_ps(ky + i);
+    __m256 vkz = _mm256_loadu_ps(kz + i);
+
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 two = _mm256_set1_ps(2.0f);
+    __m256 zero = _mm256_setzero_ps();
+
+    __m256 xx = _mm256_mul_ps(qx, qx), yy = _mm256_mul_ps(qy, qy), zz = _mm256_mul_ps(qz, qz);
+    __m256 xy = _mm256_mul_ps(qx, qy), xz = _mm256_mul_ps(qx, qz), yz = _mm256_mul_ps(qy, qz);
+    __m256 wx = _mm256_mul_ps(qw, qx), wy = _mm256_mul_ps(qw, qy), wz = _mm256_mul_ps(qw, qz);
+
+    __m256 lo[8] = {
+      _mm256_mul_ps(vkx, _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz)))),
+      _mm256_mul_ps(vky, _mm256_mul_ps(two, _mm256_add_ps(xy, wz))),
+      _mm256_mul_ps(vkz, _mm256_mul_ps(two, _mm256_sub_ps(xz, wy))),
+      zero,
+      _mm256_mul_ps(vkx, _mm256_mul_ps(two, _mm256_sub_ps(xy, wz))),
+      _mm256_mul_ps(vky, _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz)))),
+      _mm256_mul_ps(vkz, _mm256_mul_ps(two, _mm256_add_ps(yz, wx))),
+      zero
+    };
+
+    __m256 hi[8] = {
+      _mm256_mul_ps(vkx, _mm256_mul_ps(two, _mm256_add_ps(xz, wy))),
+      _mm256_mul_ps(vky, _mm256_mul_ps(two, _mm256_sub_ps(yz, wx))),
+      _mm256_mul_ps(vkz, _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy)))),
+      zero,
+      _mm256_loadu_ps(px + i),
+      _mm256_loadu_ps(py + i),
+      _mm256_loadu_ps(pz + i),
+      one
+    };
+
+    transpose8(lo);
+    transpose8(hi);
+
+    for (int k = 0; k < 8; k++) {
+      _mm256_storeu_ps(out + (i + k) * 16 + 0, lo[k]);
+      _mm256_storeu_ps(out + (i + k) * 16 + 8, hi[k]);
+    }
+  }
+
+  return i;
+}
+
+#endif
+
+void transform_batch_t::compute(int begin, int end, mat4* out) const {
+  float* m = reinterpret_cast<float*>(out);
+  int i = begin;
+
+#ifdef TRANSFORM_BATCH_AVX2
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+
+  if (has_avx2) {
+    i = compute_avx2(
+      m_px.data(), m_py.data(), m_pz.data(),
+      m_rx.data(), m_ry.data(), m_rz.data(), m_rw.data(),
+      m_sx.data(), m_sy.data(), m_sz.data(),
+      begin, end, m
+    );
+  }
+#endif
+
+  for (; i < end; i++) {
+    compose(
+      m_rx[i], m_ry[i], m_rz[i], m_rw[i],
+      m_px[i], m_py[i], m_pz[i], m_sx[i], m_sy[i], m_sz[i],
+      m + i * 16
+    );
+  }
+}
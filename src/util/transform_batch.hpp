@@ -0,0 +1,25 @@
+#ifndef TRANSFORM_BATCH_H
+#define TRANSFORM_BATCH_H
+
+#include <util/math3d.hpp>
+#include <vector>
+
+// Positions, rotations and scales stored one component per array, so eight
+// entities load into a single AVX register.
+class transform_batch_t {
+private:
+  std::vector<float> m_px, m_py, m_pz;
+  std::vector<float> m_rx, m_ry, m_rz, m_rw;
+  std::vector<float> m_sx, m_sy, m_sz;
+
+public:
+  void resize(int count);
+  int size() const;
+  void set(int i, vec3 position, quat rotation, vec3 scale);
+
+  // Writes rotate(rotation) * scale(scale) * translate(position) for
+  // entities [begin, end) into out[begin, end). Uses AVX2 when the CPU has it.
+  void compute(int begin, int end, mat4* out) const;
+};
+
+#endif